@@ -0,0 +1,177 @@
+/*
+  OV5640 focus bracketing benchmark
+  Captures a 6-step focus bracket of a simulated tilted target, one lens
+  move after another and pipelined (move issued during readout), then
+  merges the bracket into an all-in-focus frame.  A source that queues a
+  frame the way esp32-camera does checks that stale frames are dropped.
+
+  Also builds on a Linux host:
+    g++ -std=gnu++11 -O2 -Isrc -x c++ examples/OV5640_BracketBench/OV5640_BracketBench.ino -x none src/ESP32_OV5640_*.cpp -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_sim.h"
+#include "ESP32_OV5640_bracket.h"
+#include "ESP32_OV5640_check.h"
+
+#define W 320
+#define H 240
+#define SHOTS 6
+#define TILE 32
+#define BUFS (2 * SHOTS + 1)   // the sim renders round robin: room for the queued runs
+
+OV5640_Check check;
+OV5640_Sim sim;
+OV5640_SimTransport simBus(sim, 64);
+OV5640 ov5640 = OV5640();
+uint8_t* frameBufs;
+uint8_t merged[W * H];
+
+const uint16_t steps[SHOTS] = { 100, 260, 420, 580, 740, 900 };
+
+/* Driver-style source: like esp32-camera with one spare buffer, it keeps
+ * capturing, so grab() hands out the frame queued at the previous grab and
+ * only reports it exposed once it has it */
+class QueuedSource : public OV5640_FrameSource {
+public:
+  QueuedSource(OV5640_FrameSource& _inner, bool _reportStale)
+    : inner(_inner), reportStale(_reportStale), queued(false) {}
+
+  virtual bool grab(OV5640_Frame& frame) {
+    if (!queued && !inner.grab(q)) return false;
+    frame = q;
+    queued = inner.grab(q);
+    exposed();
+    return true;
+  }
+  virtual void release(OV5640_Frame& frame) { inner.release(frame); }
+  virtual uint8_t staleFrames(uint8_t held) const { (void)held; return reportStale ? 1 : 0; }
+
+  void flush() {
+    if (queued) inner.release(q);
+    queued = false;
+  }
+
+private:
+  OV5640_FrameSource& inner;
+  bool reportStale;
+  bool queued;
+  OV5640_Frame q;
+};
+
+uint32_t run(OV5640_Bracket& bracket, const char* name, bool pipeline, uint8_t settle) {
+  OV5640_BracketConfig cfg = OV5640_Bracket::defaultConfig();
+  cfg.pipeline = pipeline;
+  cfg.settleFrames = settle;
+  bracket.configure(cfg);
+
+  ov5640.manualFocus(0);
+  sim.resetCounters();
+  uint8_t rc = bracket.capture(steps, SHOTS);
+  printf("%-26s rc=%u %7.1f ms  %5.1f ms/shot  frames=%2u dropped=%u  %4.1f shots/s\n",
+         name, rc, bracket.elapsedUs / 1000.0, bracket.elapsedUs / 1000.0 / SHOTS,
+         bracket.framesGrabbed, bracket.framesDropped, SHOTS * 1e6 / bracket.elapsedUs);
+  check(rc == 0 && bracket.count() == SHOTS, "%s: captured %u of %d shots", name, bracket.count(), SHOTS);
+  return bracket.elapsedUs;
+}
+
+/* Every tile column must be won by the shot whose step is nearest the
+ * target there */
+bool shotsInPlace(OV5640_Bracket& bracket, OV5640_SimFrameSource& frames) {
+  uint8_t map[(W / TILE) * (H / TILE)];
+  if (!bracket.merge(merged, TILE, map)) return false;
+  for (uint8_t tx = 0; tx < W / TILE; tx++) {
+    uint16_t subject = frames.subjectAt(tx * TILE + TILE / 2);
+    uint8_t nearest = 0;
+    for (uint8_t k = 1; k < SHOTS; k++)
+      if (abs((int)steps[k] - subject) < abs((int)steps[nearest] - subject)) nearest = k;
+    if (map[tx] != nearest) return false;
+  }
+  return true;
+}
+
+/* Mean absolute tile sharpness gain of the merge over the best single shot */
+void mergeReport(OV5640_Bracket& bracket) {
+  uint8_t map[(W / TILE) * (H / TILE)];
+  uint32_t t0 = micros();
+  bracket.merge(merged, TILE, map);
+  uint32_t mergeUs = micros() - t0;
+
+  OV5640_Frame m = { merged, W, H, W, OV5640_FRAME_GRAY, NULL };
+  OV5640_Rect all = OV5640_Sharpness::roi(m, 0, 0, 1, 1);
+  uint32_t mergedScore = OV5640_Sharpness::tenengrad(m, all);
+  uint32_t bestSingle = 0;
+  for (uint8_t k = 0; k < bracket.count(); k++) {
+    uint32_t s = OV5640_Sharpness::tenengrad(bracket.shot(k).frame, all);
+    if (s > bestSingle) bestSingle = s;
+  }
+  printf("\nmerge %dx%d tiles: %lu us, sharpness %lu vs best single shot %lu\n",
+         TILE, TILE, (unsigned long)mergeUs, (unsigned long)mergedScore, (unsigned long)bestSingle);
+  printf("winning shot per tile column:");
+  for (uint8_t tx = 0; tx < W / TILE; tx++) printf(" %u", map[tx]);
+  printf("\n");
+  check(mergedScore > 2 * bestSingle, "merge: sharpness %lu vs best single shot %lu",
+        (unsigned long)mergedScore, (unsigned long)bestSingle);
+}
+
+void setup() {
+#if defined(ARDUINO)
+  Serial.begin(115200);
+  delay(1000);
+#endif
+  printf("\nOV5640 focus bracketing benchmark (%dx%d, %d shots)\n\n", W, H, SHOTS);
+  frameBufs = (uint8_t*)malloc((size_t)W * H * BUFS);
+
+  sim.powerOn();
+  ov5640.setClock(&sim);
+  ov5640.start(&simBus);
+  ov5640.focusInit();
+  sim.setSubjectStep(500);
+
+  OV5640_SimFrameSource frames(sim, frameBufs, W, H, OV5640_FRAME_GRAY, BUFS);
+  OV5640_SimSceneConfig scene = OV5640_SimFrameSource::defaultScene();
+  scene.depthSteps = 800;            // tilted target, steps ~100..900
+  frames.setScene(scene);
+  OV5640_Bracket bracket(ov5640, frames);
+
+  uint32_t seqUs = run(bracket, "sequential", false, 0);
+  check(shotsInPlace(bracket, frames), "sequential: every shot taken at its step");
+  run(bracket, "sequential, 1 settle frame", false, 1);
+  check(bracket.framesDropped == SHOTS, "settle: dropped %u frames, want %d", bracket.framesDropped, SHOTS);
+  uint32_t pipeUs = run(bracket, "pipelined", true, 0);
+  check(shotsInPlace(bracket, frames), "pipelined: every shot taken at its step");
+  check(pipeUs < seqUs, "pipelined: %lu us vs %lu us sequential", (unsigned long)pipeUs, (unsigned long)seqUs);
+  mergeReport(bracket);
+  bracket.release();
+
+  /* a queued frame was exposed before the move: it has to be dropped */
+  printf("\n");
+  QueuedSource naive(frames, false), queued(frames, true);
+  OV5640_Bracket naiveBracket(ov5640, naive), queuedBracket(ov5640, queued);
+  run(naiveBracket, "queued, stale kept", true, 0);
+  check(!shotsInPlace(naiveBracket, frames), "queued, stale kept: shots lag a step behind");
+  naiveBracket.release();
+  naive.flush();
+  run(queuedBracket, "queued, stale dropped", true, 0);
+  check(shotsInPlace(queuedBracket, frames), "queued, stale dropped: every shot taken at its step");
+  check(queuedBracket.framesDropped == SHOTS, "queued: dropped %u stale frames, want %d",
+        queuedBracket.framesDropped, SHOTS);
+  queuedBracket.release();
+  queued.flush();
+  check.summary();
+}
+
+void loop() {
+#if defined(ARDUINO)
+  delay(1000);
+#endif
+}
+
+#if !defined(ARDUINO)
+int main() {
+  setup();
+  return check.exitCode();
+}
+#endif
@@ -0,0 +1,210 @@
+/*
+  OV5640 core dispatch microbenchmark
+  Runs the same register-level work - warm-start probe, lens moves and a
+  full firmware upload - through OV5640_Core over different bus policies,
+  all backed by the in-RAM OV5640_MockBus so only the call overhead
+  differs:
+
+    virtual transport   OV5640_Core<OV5640_TransportBus> on a transport
+                        subclass (one virtual call per access, plus stats)
+    SCCB transport      the same on OV5640_SCCBTransport (virtual call and
+                        a sensor_t function pointer)
+    Core<SCCBBus>       sensor_t function pointer only
+    Core<MockBus>       static dispatch, inlined
+
+  and, for comparison, the lens moves through the OV5640 class itself, on
+  its built-in SCCB transport (bound at compile time) and on a transport
+  subclass.  Prints nanoseconds per operation and per register access,
+  and checks that every policy gets the same results, that the upload
+  leaves the whole image in RAM and that static dispatch beats the virtual
+  transport on the probe.
+
+  Also builds on a Linux host:
+    g++ -std=gnu++11 -O2 -Isrc -x c++ examples/OV5640_CoreBench/OV5640_CoreBench.ino -x none src/ESP32_OV5640_*.cpp -lpthread
+*/
+
+#include <stdio.h>
+#include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_core.h"
+#include "ESP32_OV5640_check.h"
+
+#define PROBES    20000
+#define MOVES     50000
+#define UPLOADS   200
+#define ROUNDS    5                     // best of
+
+/* Transport subclass over a mock register file */
+class MockTransport : public OV5640_Transport {
+public:
+  MockTransport(OV5640_MockBus& _mock, size_t _burst) : mock(_mock), burst(_burst) {}
+  virtual size_t maxBurst() const { return burst; }
+
+protected:
+  virtual int writeReg(uint16_t reg, uint8_t val) { return mock.write(reg, val); }
+  virtual int readReg(uint16_t reg) { return mock.read(reg); }
+  virtual int writeBurst(uint16_t reg, const uint8_t* data, size_t len) {
+    return mock.writeBurst(reg, data, len);
+  }
+
+private:
+  OV5640_MockBus& mock;
+  size_t burst;
+};
+
+/* sensor_t whose register hooks land in a mock */
+OV5640_MockBus sensorMock;
+
+int mockGetReg(sensor_t*, int reg, int) { return sensorMock.read(reg); }
+int mockSetReg(sensor_t*, int reg, int, int value) { return sensorMock.write(reg, value); }
+
+sensor_t mockSensor = { mockGetReg, mockSetReg };
+
+OV5640_Check check;
+
+struct Result {
+  double probeNs, moveNs, uploadUs;
+};
+
+double nsPer(uint32_t startUs, uint32_t n) {
+  return (micros() - startUs) * 1000.0 / n;
+}
+
+/* The mocks clear ACK at once: read it straight after the command */
+OV5640_PollPolicy mockPolicy() {
+  OV5640_PollPolicy p = OV5640_PollPolicy::defaults();
+  p.ackUs = 0;
+  return p;
+}
+
+/* Keep the compiler from folding the mock's register writes away */
+template <class T>
+inline void escape(T& obj) {
+  asm volatile("" : : "r"(&obj) : "memory");
+}
+
+/* One warm-start check is 18 reads, one lens move 4 writes and 1 read */
+template <class Bus>
+Result run(OV5640_Core<Bus>& core, size_t chunk) {
+  Result r = { 1e9, 1e9, 1e9 };
+  uint32_t sink = 0;
+
+  core.setPollPolicy(mockPolicy());
+  core.focusInit(true, chunk);
+  for (uint8_t round = 0; round < ROUNDS; round++) {
+    uint32_t t = micros();
+    for (uint32_t i = 0; i < PROBES; i++) {
+      sink += core.firmwareResident();
+      escape(core);
+    }
+    double ns = nsPer(t, PROBES);
+    if (ns < r.probeNs) r.probeNs = ns;
+
+    t = micros();
+    for (uint32_t i = 0; i < MOVES; i++) {
+      sink += core.manualFocus(i & 0x03FF);
+      escape(core);
+    }
+    ns = nsPer(t, MOVES);
+    if (ns < r.moveNs) r.moveNs = ns;
+
+    t = micros();
+    for (uint32_t i = 0; i < UPLOADS; i++) {
+      sink += core.focusInit(true, chunk);
+      escape(core);
+    }
+    ns = nsPer(t, UPLOADS) / 1000.0;
+    if (ns < r.uploadUs) r.uploadUs = ns;
+  }
+
+  check(sink == (uint32_t)PROBES * ROUNDS, "unexpected results (%lu)", (unsigned long)sink);
+  return r;
+}
+
+void print(const char* name, const Result& r) {
+  printf("%-22s probe %7.1f ns (%5.2f ns/read)  move %6.1f ns (%5.2f ns/access)  upload %7.1f us\n",
+         name, r.probeNs, r.probeNs / 18, r.moveNs, r.moveNs / 5, r.uploadUs);
+}
+
+void compare(const char* title, size_t chunk) {
+  printf("\n%s\n", title);
+
+  OV5640_MockBus vmock;
+  MockTransport vbus(vmock, chunk == 1 ? 0 : OV5640_BURST_DEFAULT);
+  OV5640_Core<OV5640_TransportBus> virt((OV5640_TransportBus(&vbus)));
+  Result slow = run(virt, chunk);
+  print("virtual transport", slow);
+
+  if (chunk == 1) {
+    OV5640_SCCBTransport sccb(&mockSensor);
+    OV5640_Core<OV5640_TransportBus> viaSccb((OV5640_TransportBus(&sccb)));
+    print("SCCB transport", run(viaSccb, chunk));
+
+    OV5640_Core<OV5640_SCCBBus> direct((OV5640_SCCBBus(&mockSensor)));
+    print("Core<SCCBBus>", run(direct, chunk));
+  }
+
+  OV5640_Core<OV5640_MockBus> fast;
+  Result r = run(fast, chunk);
+  print("Core<MockBus>", r);
+  check(memcmp(fast.bus().fw, OV5640_AF_Config, sizeof(fast.bus().fw)) == 0 &&
+        memcmp(vmock.fw, OV5640_AF_Config, sizeof(vmock.fw)) == 0, "upload: image not in RAM");
+  check(r.probeNs < slow.probeNs, "Core<MockBus> probe %.1f ns vs %.1f ns virtual",
+        r.probeNs, slow.probeNs);
+}
+
+/* The OV5640 class adds the async state machine and the register shadow */
+double classMoveNs(OV5640& ov5640) {
+  ov5640.setPollPolicy(mockPolicy());
+  ov5640.focusInit(true);
+  uint32_t sink = 0;
+  double moveNs = 1e9;
+  for (uint8_t round = 0; round < ROUNDS; round++) {
+    uint32_t t = micros();
+    for (uint32_t i = 0; i < MOVES; i++) sink += ov5640.manualFocus(i & 0x03FF);
+    double ns = nsPer(t, MOVES);
+    if (ns < moveNs) moveNs = ns;
+  }
+  check(sink == 0 && ov5640.currentOp()->result == 0, "OV5640: unexpected results (%lu)", (unsigned long)sink);
+  return moveNs;
+}
+
+void adapter() {
+  printf("\nOV5640 class, lens moves through the async op and shadow\n");
+
+  OV5640 viaSensor = OV5640();
+  viaSensor.start(&mockSensor);
+  printf("%-22s move %6.1f ns\n", "start(sensor_t*)", classMoveNs(viaSensor));
+
+  OV5640_MockBus mock;
+  MockTransport bus(mock, OV5640_BURST_DEFAULT);
+  OV5640 viaTransport = OV5640();
+  viaTransport.start(&bus);
+  printf("%-22s move %6.1f ns\n", "start(transport)", classMoveNs(viaTransport));
+}
+
+void setup() {
+#if defined(ARDUINO)
+  Serial.begin(115200);
+#endif
+  printf("firmware %u bytes, %u chunks of %u, probe checksum 0x%04x (all compile time)\n",
+         OV5640_Firmware::size(), OV5640_Firmware::chunks(OV5640_BURST_DEFAULT),
+         OV5640_BURST_DEFAULT, OV5640_Firmware::checksum());
+
+  compare("single-byte bus (SCCB-like)", 1);
+  compare("sequential writes, 64-byte bursts", OV5640_BURST_DEFAULT);
+  adapter();
+  check.summary();
+}
+
+void loop() {
+#if defined(ARDUINO)
+  delay(1000);
+#endif
+}
+
+#if !defined(ARDUINO)
+int main() {
+  setup();
+  return check.exitCode();
+}
+#endif
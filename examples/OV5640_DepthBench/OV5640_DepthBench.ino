@@ -0,0 +1,129 @@
+/*
+  OV5640 depth-from-focus benchmark
+  Sweeps the lens over a simulated tilted target and feeds every frame to
+  OV5640_DepthMap.  For each tile size prints accumulator throughput
+  (frames/s, rendering excluded), arena size and the per-tile step error
+  against the true subject step, then one row of the depth grid in mm,
+  and checks the arena sizing and the step error.
+
+  Also builds on a Linux host:
+    g++ -std=gnu++11 -O2 -Isrc -x c++ examples/OV5640_DepthBench/OV5640_DepthBench.ino -x none src/ESP32_OV5640_*.cpp -lpthread
+*/
+
+#include <stdio.h>
+#include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_sim.h"
+#include "ESP32_OV5640_depth.h"
+#include "ESP32_OV5640_check.h"
+
+#define W 320
+#define H 240
+#define SWEEP_FROM 0
+#define SWEEP_TO 1023
+#define SWEEP_STEP 32
+
+OV5640_Check check;
+OV5640_Sim sim;
+OV5640_SimTransport simBus(sim, 64);
+OV5640 ov5640 = OV5640();
+uint8_t frameBuf[W * H];
+OV5640_SimFrameSource frames(sim, frameBuf, W, H);
+
+/* Largest arena any of the tile sizes below needs */
+uint32_t arena[OV5640_DepthMap::arenaWords(W, H, 8)];
+uint16_t grid[((W + 7) / 8) * ((H + 7) / 8)];
+
+void sweep(uint16_t tile) {
+  OV5640_DepthMap depth;
+  size_t bytes = OV5640_DepthMap::arenaSize(W, H, tile);
+  check(bytes % 4 == 0 && bytes == 4 * OV5640_DepthMap::arenaWords(W, H, tile),
+        "tile %u: arena %lu bytes in whole words", tile, (unsigned long)bytes);
+  check(!depth.begin(arena, bytes - 4, W, H, tile), "tile %u: arena a word short rejected", tile);
+  if (!depth.begin(arena, sizeof(arena), W, H, tile)) {
+    printf("tile %2u: arena too small\n", tile);
+    return;
+  }
+  depth.setMinScore(20);
+
+  uint32_t addUs = 0;
+  for (uint16_t s = SWEEP_FROM; s <= SWEEP_TO; s += SWEEP_STEP) {
+    ov5640.manualFocus(s);
+    OV5640_Frame f;
+    frames.grab(f);
+    uint32_t t0 = micros();
+    depth.add(f, s);
+    addUs += micros() - t0;
+    frames.release(f);
+  }
+
+  /* true subject step at the tile centre column; the target only tilts in x */
+  uint32_t errSum = 0, known = 0;
+  for (uint16_t y = 0; y < depth.tilesY(); y++) {
+    for (uint16_t x = 0; x < depth.tilesX(); x++) {
+      uint16_t s = depth.step(x, y);
+      if (s == OV5640_DEPTH_UNKNOWN) continue;
+      uint16_t cx = x * tile + tile / 2 < W ? x * tile + tile / 2 : W - 1;
+      uint16_t truth = frames.subjectAt(cx);
+      errSum += s > truth ? s - truth : truth - s;
+      known++;
+    }
+  }
+  printf("tile %2u: %3ux%-3u tiles  arena %5lu B  %7.1f frames/s  step error %5.1f  known %lu/%u\n",
+         tile, depth.tilesX(), depth.tilesY(), (unsigned long)bytes,
+         depth.frames() * 1e6 / (addUs ? addUs : 1), known ? (double)errSum / known : 0.0,
+         (unsigned long)known, depth.tilesX() * depth.tilesY());
+  check(known == (uint32_t)depth.tilesX() * depth.tilesY(), "tile %u: every tile textured", tile);
+  if (tile <= 32)
+    check(errSum <= known * SWEEP_STEP / 2, "tile %u: step error %.1f within half a sweep step",
+          tile, known ? (double)errSum / known : 0.0);
+
+  depth.depthGrid(grid, *ov5640.getFocusCalibration());
+  printf("         mm, middle row:");
+  uint16_t row = depth.tilesY() / 2;
+  for (uint16_t x = 0; x < depth.tilesX(); x += (depth.tilesX() + 9) / 10)
+    printf(" %u", grid[row * depth.tilesX() + x]);
+  printf("\n");
+
+  /* the target comes closer from left to right */
+  uint16_t first = grid[row * depth.tilesX()], last = grid[row * depth.tilesX() + depth.tilesX() - 1];
+  check(first > last, "tile %u: %u mm on the left, %u mm on the right", tile, first, last);
+}
+
+void setup() {
+#if defined(ARDUINO)
+  Serial.begin(115200);
+  delay(1000);
+#endif
+  printf("\nOV5640 depth-from-focus benchmark (%dx%d, %d-step sweep)\n\n",
+         W, H, (SWEEP_TO - SWEEP_FROM) / SWEEP_STEP + 1);
+
+  sim.powerOn();
+  ov5640.setClock(&sim);
+  ov5640.start(&simBus);
+  ov5640.focusInit();
+  sim.setSubjectStep(500);
+
+  OV5640_SimSceneConfig scene = OV5640_SimFrameSource::defaultScene();
+  scene.depthSteps = 800;            // tilted target, steps ~100..900
+  frames.setScene(scene);
+
+  check(OV5640_DepthMap::arenaSize(8, 8, 8) == 8, "one tile: %lu arena bytes, want 6 rounded up to 8",
+        (unsigned long)OV5640_DepthMap::arenaSize(8, 8, 8));
+
+  uint16_t tiles[] = { 8, 16, 32, 64 };
+  for (uint8_t i = 0; i < sizeof(tiles) / sizeof(tiles[0]); i++) sweep(tiles[i]);
+  check.summary();
+}
+
+void loop() {
+#if defined(ARDUINO)
+  delay(1000);
+#endif
+}
+
+#if !defined(ARDUINO)
+int main() {
+  setup();
+  return check.exitCode();
+}
+#endif
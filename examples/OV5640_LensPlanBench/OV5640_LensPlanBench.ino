@@ -0,0 +1,188 @@
+/*
+  OV5640 lens trajectory planner benchmark
+  Moves the simulated lens by deltas from 8 steps to the full range and
+  measures move-to-sharp latency, i.e. from the first command until the
+  lens stays within 4 steps of the target, for:
+
+    delay(100)      plain manualFocus() and a fixed wait, as callers do now
+    jump + model    one jump, capture at the planner's settled estimate
+    ZV / ZVD        the move split into 2 / 3 shaped segments
+
+  The simulator's lens is a damped mass on the VCM spring, integrated on
+  its own; the planner keeps its generic model (10 ms period, 30 ms decay,
+  i.e. 100 Hz at damping 0.053) throughout.  Each lens below is a
+  different module: on the model, inside its 10% uncertainty, and outside
+  it.
+
+  "ready" is when capture would start: after the fixed wait or at
+  settledAtUs().  A ready before sharp (marked '!') means that frame would
+  be taken while the lens still rings.
+
+  Checks that no segment is issued late, that the planner never captures
+  early on the lenses within its uncertainty, and that on the model's lens
+  ZVD is ready before both delay(100) and the plain jump for every move
+  short of the full range (a full-range move is a single segment).
+
+  Also builds on a Linux host:
+    g++ -std=gnu++11 -O2 -Isrc -x c++ examples/OV5640_LensPlanBench/OV5640_LensPlanBench.ino -x none src/ESP32_OV5640_*.cpp -lpthread
+*/
+
+#include <stdio.h>
+#include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_sim.h"
+#include "ESP32_OV5640_trajectory.h"
+#include "ESP32_OV5640_check.h"
+
+#define TOLERANCE 4       // steps, the depth of field at the target
+#define SAMPLE_US 100
+#define WINDOW_US 500000
+
+OV5640_Sim sim;
+OV5640_SimTransport simBus(sim, 64);
+OV5640 ov5640 = OV5640();
+OV5640_LensPlanner planner(ov5640);
+
+static const uint16_t DELTAS[] = { 8, 32, 128, 512, 1023 };
+
+struct Lens {
+  float hz, damping;
+  const char* note;
+};
+
+/* The first INSIDE lenses are within the planner's uncertainty */
+#define INSIDE 4
+
+static const Lens LENSES[] = {
+  { 100, 0.053f, "the planner's model" },
+  { 94,  0.053f, "6% slower" },
+  { 108, 0.053f, "8% faster" },
+  { 100, 0.08f,  "better damped" },
+  { 100, 0.035f, "rings longer than modelled" },
+  { 80,  0.03f,  "a different module" },
+};
+
+uint32_t moves, early;
+int32_t worstUs;
+OV5640_Check check;
+
+/* Capture and sharp times of one move, us after the first command */
+struct Move {
+  uint32_t readyUs, sharpUs;
+};
+
+/* Park the lens at step and let it ring out */
+void park(uint16_t step) {
+  ov5640.manualFocus(step);
+  sim.advanceUs(1000000);
+  planner.setPosition(step);
+}
+
+/* Report a strategy: ready and sharp, '!' when the frame would be soft */
+void report(uint32_t readyUs, uint32_t sharpUs) {
+  int32_t margin = (int32_t)readyUs - (int32_t)sharpUs;
+  moves++;
+  if (margin < 0) {
+    early++;
+    if (margin < worstUs) worstUs = margin;
+  }
+  printf("  %6.1f %6.1f%c", readyUs / 1000.0, sharpUs / 1000.0, margin < 0 ? '!' : ' ');
+}
+
+/* One planned move of delta with the given shaping order.  The planner is
+ * polled every SAMPLE_US while the lens position is sampled; sharp is
+ * when it is within TOLERANCE of the target for good.  With fixedWait,
+ * also reports the plain jump followed by delay(100). */
+Move planned(uint16_t delta, uint8_t order, Move* fixedWait = NULL) {
+  OV5640_LensPlanConfig c = OV5640_LensPlanner::defaultConfig();
+  c.order = order;
+  c.toleranceSteps = TOLERANCE;
+  planner.configure(c);
+
+  park(0);
+  uint32_t t0 = sim.nowUs();
+  uint32_t done = 0, lastBad = t0;
+  planner.moveAsync(delta);
+  for (uint32_t t = t0; t - t0 < WINDOW_US; t = sim.nowUs()) {
+    if (!planner.poll() && !done) done = t - t0;
+    uint16_t p = sim.lensPosition();
+    if (sim.lensMoving() || (p > delta ? p - delta : delta - p) > TOLERANCE) lastBad = t;
+    sim.advanceUs(SAMPLE_US);
+  }
+  uint32_t sharp = lastBad + SAMPLE_US - t0;
+
+  /* the same jump with a fixed wait after manualFocus() returns */
+  if (fixedWait) {
+    fixedWait->readyUs = done + 100000;
+    fixedWait->sharpUs = sharp;
+    report(fixedWait->readyUs, sharp);
+  }
+  Move m = { planner.settledAtUs() - t0, sharp };
+  report(m.readyUs, sharp);
+  printf("%4u", planner.currentPlan().count);
+  return m;
+}
+
+void setup() {
+#if defined(ARDUINO)
+  Serial.begin(115200);
+#endif
+  ov5640.setClock(&sim);
+
+  printf("move-to-sharp from step 0, tolerance %u steps (ms after the first command)\n",
+         TOLERANCE);
+  for (uint8_t l = 0; l < sizeof(LENSES) / sizeof(LENSES[0]); l++) {
+    OV5640_SimConfig cfg = OV5640_Sim::defaultConfig();
+    cfg.lensResonanceHz = LENSES[l].hz;
+    cfg.lensDamping = LENSES[l].damping;
+    sim.configure(cfg);
+    sim.powerOn();
+    ov5640.start(&simBus);
+    ov5640.focusInit();
+
+    printf("\nlens %.0f Hz, damping %.3f: %s\n", LENSES[l].hz, LENSES[l].damping,
+           LENSES[l].note);
+    printf("  %5s  %-14s  %-18s  %-18s  %-18s\n", "delta", "delay(100)", "jump + model",
+           "ZV", "ZVD");
+    printf("  %5s  %6s %6s ", "", "ready", "sharp");
+    for (uint8_t k = 0; k < 3; k++) printf("  %6s %6s %4s", "ready", "sharp", "segs");
+    printf("\n");
+    for (uint8_t i = 0; i < sizeof(DELTAS) / sizeof(DELTAS[0]); i++) {
+      printf("  %5u", DELTAS[i]);
+      Move wait;
+      Move jump = planned(DELTAS[i], 0, &wait);
+      Move zv = planned(DELTAS[i], 1);
+      Move zvd = planned(DELTAS[i], 2);
+      printf("\n");
+      if (l < INSIDE) {
+        check(jump.readyUs >= jump.sharpUs && zv.readyUs >= zv.sharpUs && zvd.readyUs >= zvd.sharpUs,
+              "%s, delta %u: planned capture before the lens was sharp", LENSES[l].note, DELTAS[i]);
+      }
+      if (l == 0 && DELTAS[i] < 1023) {
+        check(zvd.readyUs < wait.readyUs && zvd.readyUs < jump.readyUs,
+              "delta %u: ZVD ready at %lu us vs %lu delay(100), %lu jump", DELTAS[i],
+              (unsigned long)zvd.readyUs, (unsigned long)wait.readyUs, (unsigned long)jump.readyUs);
+      }
+    }
+  }
+
+  const OV5640_LensPlanStats& st = planner.stats();
+  printf("\n%lu of %lu captures before the lens was sharp, worst by %.1f ms\n",
+         (unsigned long)early, (unsigned long)moves, -worstUs / 1000.0);
+  printf("planner: %lu moves, %lu segments, %lu issued late\n", (unsigned long)st.moves,
+         (unsigned long)st.segments, (unsigned long)st.late);
+  check(st.late == 0, "planner: %lu segments issued late", (unsigned long)st.late);
+  check.summary();
+}
+
+void loop() {
+#if defined(ARDUINO)
+  delay(1000);
+#endif
+}
+
+#if !defined(ARDUINO)
+int main() {
+  setup();
+  return check.exitCode();
+}
+#endif
@@ -0,0 +1,120 @@
+/*
+  OV5640 multi-camera benchmark
+  Brings up 1..8 simulated sensors, each on its own transport, first one
+  after another and then in parallel through OV5640_Manager.  The
+  simulators run in real time so the wall clock shows the overlap: with
+  parallel workers bring-up stays close to a single camera's time.
+  The checks use each simulator's virtual clock, which does not depend on
+  the host's load: one after another, bring-up of N cameras adds up to N
+  times one camera; in parallel, it ends with the slowest camera, which
+  must stay within 1.5 times of one camera alone.  Exits non-zero if a
+  check fails.
+
+  Also builds on a Linux host:
+    g++ -std=gnu++11 -Isrc -x c++ examples/OV5640_MultiCamBench/OV5640_MultiCamBench.ino -x none src/ESP32_OV5640_*.cpp -lpthread
+*/
+
+#include <stdio.h>
+#include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_sim.h"
+#include "ESP32_OV5640_check.h"
+#include "ESP32_OV5640_multi.h"
+
+#define CAMS 8
+#define SLACK_PCT 150     // parallel bring-up of N vs one camera, virtual time
+
+OV5640_Sim sims[CAMS];
+OV5640_SimTransport* buses[CAMS];
+OV5640 cams[CAMS];
+OV5640_Check check;
+
+void powerOnAll(uint8_t n) {
+  for (uint8_t i = 0; i < n; i++) {
+    sims[i].powerOn();
+    cams[i].start(buses[i]);
+  }
+}
+
+/* @returns the virtual time of n bring-ups in a row */
+uint32_t sequential(uint8_t n) {
+  powerOnAll(n);
+  uint32_t t0 = micros(), simUs = 0;
+  uint8_t failed = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    uint32_t s0 = sims[i].nowUs();
+    if (cams[i].focusInit()) failed++;
+    simUs += sims[i].nowUs() - s0;
+  }
+  printf("sequential   N=%u  focusInit wall=%7.1f ms sim=%7.1f ms failed=%u\n",
+         n, (micros() - t0) / 1000.0, simUs / 1000.0, failed);
+  check(failed == 0, "sequential: every camera ready");
+  return simUs;
+}
+
+/* @returns the virtual time of focusInitAll(): its slowest camera */
+uint32_t parallel(uint8_t n) {
+  OV5640_Manager mgr;
+  powerOnAll(n);
+  for (uint8_t i = 0; i < n; i++) mgr.add(&cams[i]);
+
+  uint32_t t0 = micros();
+  mgr.focusInitAll();
+  uint8_t failed = mgr.waitAll();
+  uint32_t initUs = micros() - t0;
+  uint32_t slowest = 0;
+  for (uint8_t i = 0; i < n; i++)
+    if (mgr.durationUs(i) > slowest) slowest = mgr.durationUs(i);
+
+  t0 = micros();
+  mgr.manualFocusAll(512);
+  failed += mgr.waitAll();
+  uint32_t moveUs = micros() - t0;
+
+  printf("parallel     N=%u  focusInit wall=%7.1f ms (slowest camera %6.1f ms) "
+         "manualFocusAll=%6.1f ms ready=%s failed=%u\n",
+         n, initUs / 1000.0, slowest / 1000.0, moveUs / 1000.0,
+         mgr.allReady() ? "yes" : "no", failed);
+  check(failed == 0 && mgr.allReady(), "parallel: every camera ready");
+  return slowest;
+}
+
+void setup() {
+#if defined(ARDUINO)
+  Serial.begin(115200);
+  delay(1000);
+#endif
+  printf("\nOV5640 multi-camera benchmark\n\n");
+
+  for (uint8_t i = 0; i < CAMS; i++) {
+    OV5640_SimConfig cfg = OV5640_Sim::defaultConfig();
+    cfg.realTime = true;
+    sims[i].configure(cfg);
+    buses[i] = new OV5640_SimTransport(sims[i], 64);
+    cams[i].setClock(&sims[i]);
+  }
+
+  uint32_t one = sequential(1);
+  uint32_t four = sequential(4);
+  check(four >= 4 * (uint64_t)one * 90 / 100, "sequential: N=4 took %lu us, one camera %lu us",
+        (unsigned long)four, (unsigned long)one);
+  check(parallel(1) <= (uint64_t)one * SLACK_PCT / 100, "parallel: N=1 within %u%% of sequential", SLACK_PCT);
+  for (uint8_t n = 2; n <= CAMS; n *= 2) {
+    check(parallel(n) <= (uint64_t)one * SLACK_PCT / 100,
+          "parallel: N=%u within %u%% of one camera", n, SLACK_PCT);
+  }
+
+  check.summary();
+}
+
+void loop() {
+#if defined(ARDUINO)
+  delay(1000);
+#endif
+}
+
+#if !defined(ARDUINO)
+int main() {
+  setup();
+  return check.exitCode();
+}
+#endif
@@ -0,0 +1,154 @@
+/*
+  OV5640 scene-gated refocus benchmark
+  30 s of simulated 30 fps video: the subject moves twice and someone
+  walks across the frame once, taking 2 s.  Compares continuous AF (with the usual
+  per-frame status read) against OV5640_Refocus driving single-shot AF
+  and software AF.  Prints refocus events, firmware AF searches, bus
+  traffic and the share of frames with the lens on the subject, and checks
+  that gating refocuses less with less bus traffic, keeps the lens on the
+  subject, ignores the passer-by and, with software AF, runs no firmware
+  search at all.
+
+  Also builds on a Linux host:
+    g++ -std=gnu++11 -O2 -Isrc -x c++ examples/OV5640_RefocusBench/OV5640_RefocusBench.ino -x none src/ESP32_OV5640_*.cpp -lpthread
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_sim.h"
+#include "ESP32_OV5640_softaf.h"
+#include "ESP32_OV5640_refocus.h"
+#include "ESP32_OV5640_check.h"
+
+#define W 160
+#define H 120
+#define RUN_US 30000000UL
+
+OV5640_Sim sim;
+OV5640_SimTransport simBus(sim, 64);
+OV5640 ov5640 = OV5640();
+uint8_t frameBuf[W * H];
+OV5640_SimFrameSource frames(sim, frameBuf, W, H);
+OV5640_SoftAF softAF(ov5640, frames);
+
+enum Mode { CONTINUOUS, GATED_SINGLE, GATED_SOFT };
+
+struct RunStats {
+  uint32_t refocuses, searches, transactions;
+  uint32_t passerBy;            // refocuses while or just after someone walked through
+  double inFocusPct;
+};
+
+OV5640_Check check;
+
+/* Scene script: subject steps and a passer-by, by time since start */
+void stage(uint32_t t) {
+  sim.setSubjectStep(t < 5000000 ? 500 : (t < 20000000 ? 300 : 700));
+}
+
+#define PASS_START  12000000UL
+#define PASS_US     2000000UL
+#define PASSER_W    40
+
+/* The passer-by walks left to right across the frame from PASS_START;
+ * @returns false when nobody is in the frame, else the left edge */
+bool passerBy(uint32_t t, int16_t& x) {
+  if (t < PASS_START || t >= PASS_START + PASS_US) return false;
+  x = (int16_t)((uint64_t)(t - PASS_START) * (W + PASSER_W) / PASS_US) - PASSER_W;
+  return true;
+}
+
+RunStats run(const char* name, Mode mode) {
+  sim.powerOn();
+  ov5640.start(&simBus);
+  ov5640.focusInit();
+  ov5640.manualFocus(0);
+  stage(0);
+
+  OV5640_Refocus gate(ov5640, &softAF);
+  OV5640_RefocusConfig cfg = OV5640_Refocus::defaultConfig();
+  cfg.softAF = mode == GATED_SOFT;
+  gate.configure(cfg);
+
+  sim.resetCounters();
+  uint32_t t0 = sim.nowUs();
+  if (mode == CONTINUOUS) ov5640.autoFocusMode();
+  else gate.begin();
+
+  uint32_t nFrames = 0, sharpFrames = 0, beforePass = 0, afterPass = 0;
+  while (sim.nowUs() - t0 < RUN_US) {
+    uint32_t t = sim.nowUs() - t0;
+    stage(t);
+    if (t < PASS_START) beforePass = gate.stats().refocuses;
+    if (t < PASS_START + 2 * PASS_US) afterPass = gate.stats().refocuses;
+
+    OV5640_Frame f;
+    uint16_t lens = sim.lensPosition();
+    frames.grab(f);
+    int16_t x;
+    if (passerBy(t, x)) {
+      int16_t x0 = x < 0 ? 0 : x, x1 = x + PASSER_W > W ? W : x + PASSER_W;
+      for (uint16_t y = 20; y < 100; y++) memset(frameBuf + y * W + x0, 20, x1 - x0);
+    }
+    nFrames++;
+    uint16_t subject = sim.getSubjectStep();
+    if ((lens > subject ? lens - subject : subject - lens) <= 16) sharpFrames++;
+
+    if (mode == CONTINUOUS) ov5640.getFWStatus();
+    else gate.update(f);
+    frames.release(f);
+  }
+
+  uint32_t refocuses = mode == CONTINUOUS ? sim.afSearches : gate.stats().refocuses;
+  printf("%-22s refocus=%3lu fw searches=%3lu txns=%5lu polls=%5lu in focus=%5.1f%%\n",
+         name, (unsigned long)refocuses, (unsigned long)sim.afSearches,
+         (unsigned long)sim.transactions, (unsigned long)sim.pollReads,
+         100.0 * sharpFrames / nFrames);
+  RunStats r = { refocuses, sim.afSearches, sim.transactions, afterPass - beforePass,
+                 100.0 * sharpFrames / nFrames };
+  return r;
+}
+
+void setup() {
+#if defined(ARDUINO)
+  Serial.begin(115200);
+  delay(1000);
+#endif
+  printf("\nOV5640 scene-gated refocus benchmark (30 s, 30 fps)\n\n");
+  ov5640.setClock(&sim);
+
+  RunStats caf = run("continuous AF", CONTINUOUS);
+  RunStats single = run("gated, single-shot AF", GATED_SINGLE);
+  RunStats soft = run("gated, software AF", GATED_SOFT);
+
+  const RunStats* gated[] = { &single, &soft };
+  const char* names[] = { "single-shot", "software" };
+  for (uint8_t i = 0; i < 2; i++) {
+    const RunStats& g = *gated[i];
+    /* the first lock and one per subject move */
+    check(g.refocuses == 3 && g.refocuses < caf.refocuses, "%s: %lu refocuses vs %lu continuous",
+          names[i], (unsigned long)g.refocuses, (unsigned long)caf.refocuses);
+    check(g.transactions < caf.transactions / 2, "%s: %lu transactions vs %lu continuous", names[i],
+          (unsigned long)g.transactions, (unsigned long)caf.transactions);
+    check(g.inFocusPct >= caf.inFocusPct, "%s: %.1f%% in focus vs %.1f%% continuous", names[i],
+          g.inFocusPct, caf.inFocusPct);
+    check(g.passerBy == 0, "%s: %lu refocuses for the passer-by", names[i], (unsigned long)g.passerBy);
+  }
+  check(single.searches == single.refocuses, "single-shot: one firmware search per refocus");
+  check(soft.searches == 0, "software: %lu firmware searches", (unsigned long)soft.searches);
+  check.summary();
+}
+
+void loop() {
+#if defined(ARDUINO)
+  delay(1000);
+#endif
+}
+
+#if !defined(ARDUINO)
+int main() {
+  setup();
+  return check.exitCode();
+}
+#endif
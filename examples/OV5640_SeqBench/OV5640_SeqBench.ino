@@ -0,0 +1,234 @@
+/*
+  OV5640 register sequence player benchmark
+  Plays the AF presets and a layered sensor mode table (full-size window,
+  then a VGA output overlay with binning, inside a group hold) against the
+  simulator three ways:
+
+    naive           every op in table order, one register per transaction
+    player, SCCB    OV5640::playSequence() on sensor_t: overwritten writes
+                    dropped, masked writes folded
+    player, burst   the same on a transport with 64-byte sequential writes:
+                    runs of adjacent registers merged as well
+    unordered       the mode table with OV5640_Seq::unordered() after the
+                    group hold, so the player may sort it by address
+
+  and prints write transactions, register bytes on the bus and bus time.
+  The mode table is illustrative; the simulator only models the AF block,
+  so it just counts the other writes.  A recording transport then checks
+  that the player leaves the registers as naive playback does and, unless
+  told unordered(), writes them in table order.
+
+  Also builds on a Linux host:
+    g++ -std=gnu++11 -O2 -Isrc -x c++ examples/OV5640_SeqBench/OV5640_SeqBench.ino -x none src/ESP32_OV5640_*.cpp -lpthread
+*/
+
+#include <stdio.h>
+#include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_sim.h"
+#include "ESP32_OV5640_check.h"
+
+/* Full-size window and timing, then the VGA overlay; the overlay rewrites
+ * the output size, so the player sends those four registers once */
+static constexpr OV5640_SeqOp MODE_VGA[] = {
+  OV5640_Seq::write(OV5640_GROUP_ACCESS, 0x03),  // group 3 hold
+  OV5640_Seq::write(0x3800, 0x00), OV5640_Seq::write(0x3801, 0x00),
+  OV5640_Seq::write(0x3802, 0x00), OV5640_Seq::write(0x3803, 0x00),
+  OV5640_Seq::write(0x3804, 0x0a), OV5640_Seq::write(0x3805, 0x3f),
+  OV5640_Seq::write(0x3806, 0x07), OV5640_Seq::write(0x3807, 0x9f),
+  OV5640_Seq::write(0x3808, 0x0a), OV5640_Seq::write(0x3809, 0x20),
+  OV5640_Seq::write(0x380a, 0x07), OV5640_Seq::write(0x380b, 0x98),
+  OV5640_Seq::write(0x380c, 0x0b), OV5640_Seq::write(0x380d, 0x1c),
+  OV5640_Seq::write(0x380e, 0x07), OV5640_Seq::write(0x380f, 0xb0),
+  OV5640_Seq::write(0x3810, 0x00), OV5640_Seq::write(0x3811, 0x10),
+  OV5640_Seq::write(0x3812, 0x00), OV5640_Seq::write(0x3813, 0x06),
+  OV5640_Seq::write(0x3814, 0x11), OV5640_Seq::write(0x3815, 0x11),
+  OV5640_Seq::write(0x3821, 0x00),
+  /* VGA overlay */
+  OV5640_Seq::write(0x3808, 0x02), OV5640_Seq::write(0x3809, 0x80),
+  OV5640_Seq::write(0x380a, 0x01), OV5640_Seq::write(0x380b, 0xe0),
+  OV5640_Seq::write(0x3814, 0x31), OV5640_Seq::write(0x3815, 0x31),
+  OV5640_Seq::mask(0x3821, 0x01, 0x01),           // horizontal binning
+  OV5640_Seq::write(OV5640_GROUP_ACCESS, 0x13),  // end group 3
+  OV5640_Seq::write(OV5640_GROUP_ACCESS, 0xa3),  // launch
+};
+
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+#define LOG_MAX   128
+
+/* Register file for 0x3000-0x3fff that logs every byte written, in order */
+class Recorder : public OV5640_Transport {
+public:
+  Recorder(size_t _burst) : count(0), burst(_burst) {
+    memset(regs, 0, sizeof(regs));
+    regs[OV5640_CHIPID_HIGH & 0x0fff] = 0x56;
+    regs[OV5640_CHIPID_LOW & 0x0fff] = 0x40;
+  }
+  virtual size_t maxBurst() const { return burst; }
+  void clear() { count = 0; }
+
+  uint16_t reg[LOG_MAX];
+  uint8_t val[LOG_MAX];
+  size_t count;
+  uint8_t regs[0x1000];
+
+protected:
+  virtual int writeReg(uint16_t r, uint8_t v) {
+    if (count < LOG_MAX) {
+      reg[count] = r;
+      val[count++] = v;
+    }
+    regs[r & 0x0fff] = v;
+    return 0;
+  }
+  virtual int readReg(uint16_t r) { return regs[r & 0x0fff]; }
+  virtual int writeBurst(uint16_t r, const uint8_t* data, size_t len) {
+    _stats.transactions++;
+    _stats.bytes += 2 + len;
+    _stats.writes += len;
+    for (size_t i = 0; i < len; i++) writeReg(r + i, data[i]);
+    return 0;
+  }
+
+private:
+  size_t burst;
+};
+
+OV5640_Sim sim;
+OV5640_SimTransport burstBus(sim, 64);
+OV5640 ov5640 = OV5640();
+OV5640_Check check;
+Recorder naiveLog(0), sccbLog(0), burstLog(64), sortedLog(64);
+OV5640_SeqOp modeSorted[COUNT(MODE_VGA) + 1];
+
+/* Reference: table order, one transaction per register */
+uint8_t playNaive(const OV5640_SeqOp* seq, size_t n) {
+  OV5640_Transport* t = ov5640.getTransport();
+  for (size_t i = 0; i < n; i++) {
+    const OV5640_SeqOp& s = seq[i];
+    int v;
+    uint32_t start;
+    switch (s.op) {
+      case OV5640_SEQ_WRITE:
+        t->write(s.reg, s.val);
+        break;
+      case OV5640_SEQ_MASK:
+        v = t->read(s.reg);
+        t->write(s.reg, (v & ~s.mask) | (s.val & s.mask));
+        break;
+      case OV5640_SEQ_WAIT:
+        start = sim.nowUs();
+        while (((v = t->read(s.reg)) & s.mask) != s.val) {
+          if (sim.nowUs() - start > OV5640_POLL_TIMEOUT_MS * 1000UL) return 1;
+          sim.sleepMs(1);
+        }
+        break;
+      case OV5640_SEQ_DELAY:
+        sim.sleepMs(s.ms);
+        break;
+    }
+  }
+  return 0;
+}
+
+/* @returns write transactions */
+uint32_t run(const char* name, const OV5640_SeqOp* seq, size_t n, bool naive) {
+  OV5640_BusStats before = ov5640.busStats();
+  uint32_t t0 = sim.nowUs();
+  uint8_t rc = naive ? playNaive(seq, n) : ov5640.playSequence(seq, n);
+  uint32_t us = sim.nowUs() - t0;
+  const OV5640_BusStats& after = ov5640.busStats();
+  uint32_t writeTxns = (after.transactions - before.transactions) - 2 * (after.reads - before.reads);
+  printf("  %-16s rc=%u write txns=%3lu reg bytes=%3lu bus txns=%3lu time=%7.2f ms\n",
+         name, rc, (unsigned long)writeTxns, (unsigned long)(after.writes - before.writes),
+         (unsigned long)(after.transactions - before.transactions), us / 1000.0);
+  check(rc == 0, "%s: rc=%u", name, rc);
+  return writeTxns;
+}
+
+/* @returns write transactions of naive, player on sensor_t, player with bursts */
+void compare(const char* title, const OV5640_SeqOp* seq, size_t n, uint32_t* txns) {
+  printf("\n%s (%u ops)\n", title, (unsigned)n);
+
+  ov5640.start(sim.sensor());
+  txns[0] = run("naive", seq, n, true);
+  txns[1] = run("player, SCCB", seq, n, false);
+
+  ov5640.start(&burstBus);
+  txns[2] = run("player, burst", seq, n, false);
+}
+
+/* Play seq into log, naively or through the player */
+void record(Recorder& log, const OV5640_SeqOp* seq, size_t n, bool naive) {
+  ov5640.start(&log);
+  log.clear();
+  if (naive) playNaive(seq, n);
+  else ov5640.playSequence(seq, n);
+}
+
+/* Every write of b is in a, in the same order */
+bool inOrder(const Recorder& a, const Recorder& b) {
+  size_t i = 0;
+  for (size_t j = 0; j < b.count; j++) {
+    while (i < a.count && (a.reg[i] != b.reg[j] || a.val[i] != b.val[j])) i++;
+    if (i++ == a.count) return false;
+  }
+  return true;
+}
+
+void setup() {
+#if defined(ARDUINO)
+  Serial.begin(115200);
+#endif
+  ov5640.setClock(&sim);
+  sim.powerOn();
+  ov5640.start(&burstBus);
+  ov5640.focusInit();
+
+  uint32_t af[3], mode[3];
+  compare("AF pause", OV5640_SEQ_AF_PAUSE, COUNT(OV5640_SEQ_AF_PAUSE), af);
+  compare("AF continuous", OV5640_SEQ_AF_CONTINUOUS, COUNT(OV5640_SEQ_AF_CONTINUOUS), af);
+  compare("mode switch: full window + VGA overlay", MODE_VGA, COUNT(MODE_VGA), mode);
+
+  /* the same table with the writes after the group hold marked unordered */
+  modeSorted[0] = MODE_VGA[0];
+  modeSorted[1] = OV5640_Seq::unordered();
+  memcpy(modeSorted + 2, MODE_VGA + 1, sizeof(MODE_VGA) - sizeof(MODE_VGA[0]));
+  uint32_t sortedTxns = run("unordered, burst", modeSorted, COUNT(modeSorted), false);
+
+  const OV5640_SeqStats& st = ov5640.sequenceStats();
+  printf("\nplayer totals: ops=%lu writes=%lu txns=%lu reads=%lu dropped=%lu\n",
+         (unsigned long)st.ops, (unsigned long)st.writes, (unsigned long)st.transactions,
+         (unsigned long)st.reads, (unsigned long)st.dropped);
+
+  check(mode[1] < mode[0], "mode table: the player drops overwritten writes");
+  check(mode[2] < mode[1], "mode table: bursts merge adjacent registers");
+  check(sortedTxns < mode[2], "mode table: unordered() merges more");
+
+  record(naiveLog, MODE_VGA, COUNT(MODE_VGA), true);
+  record(sccbLog, MODE_VGA, COUNT(MODE_VGA), false);
+  record(burstLog, MODE_VGA, COUNT(MODE_VGA), false);
+  record(sortedLog, modeSorted, COUNT(modeSorted), false);
+  ov5640.start(&burstBus);
+  check(!memcmp(sccbLog.regs, naiveLog.regs, sizeof(naiveLog.regs)) &&
+        !memcmp(burstLog.regs, naiveLog.regs, sizeof(naiveLog.regs)) &&
+        !memcmp(sortedLog.regs, naiveLog.regs, sizeof(naiveLog.regs)),
+        "mode table: the player leaves the registers as naive playback does");
+  check(inOrder(naiveLog, sccbLog) && inOrder(naiveLog, burstLog),
+        "mode table: the player keeps table order");
+  check(!inOrder(naiveLog, sortedLog), "mode table: unordered() lets the player sort");
+
+  check.summary();
+}
+
+void loop() {
+#if defined(ARDUINO)
+  delay(1000);
+#endif
+}
+
+#if !defined(ARDUINO)
+int main() {
+  setup();
+  return check.exitCode();
+}
+#endif
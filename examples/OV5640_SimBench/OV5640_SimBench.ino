@@ -0,0 +1,217 @@
+/*
+  OV5640 AF simulator benchmark
+  Runs the AF library against the built-in sensor model, so no camera is
+  needed.  Prints simulated time, wall time, bus transactions and poll
+  reads for each operation, and checks the firmware upload: the same
+  register bytes either way, one transaction per byte through sensor_t
+  and one per 64-byte chunk through the burst transport.  Also checks that
+  a warm focusInit() reuses the resident firmware without uploading it, and
+  that a corrupted probe byte forces a reload.  Exits non-zero when a check
+  fails.
+
+  Also builds on a Linux host:
+    g++ -std=gnu++11 -Isrc -x c++ examples/OV5640_SimBench/OV5640_SimBench.ino -x none src/ESP32_OV5640_*.cpp
+*/
+
+#include <stdio.h>
+#include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_sim.h"
+#include "ESP32_OV5640_check.h"
+
+OV5640_Sim sim;
+OV5640_SimTransport simBus(sim, 64);
+OV5640 ov5640 = OV5640();
+
+uint32_t simStart, wallStart;
+OV5640_Check check;
+
+void begin() {
+  sim.resetCounters();
+  simStart = sim.nowUs();
+  wallStart = micros();
+}
+
+void report(const char* name, uint8_t rc) {
+  uint32_t simUs = sim.nowUs() - simStart;
+  uint32_t wallUs = micros() - wallStart;
+  printf("%-28s rc=%u sim=%8.2f ms wall=%8lu us txns=%6lu polls=%4lu\n",
+         name, rc, simUs / 1000.0, (unsigned long)wallUs,
+         (unsigned long)sim.transactions, (unsigned long)sim.pollReads);
+}
+
+/* Random lens moves under a poll policy; prints the manual-move histogram
+ * and returns the status reads, meanUs the mean latency */
+uint32_t pollPolicyRun(const char* name, const OV5640_PollPolicy& policy, uint32_t& meanUs) {
+  uint32_t seed = 1;
+  ov5640.setPollPolicy(policy);
+  ov5640.clearLatency();
+  begin();
+  for (uint8_t i = 0; i < 50; i++) {
+    seed = seed * 1103515245 + 12345;
+    ov5640.manualFocus((seed >> 16) & 0x03FF);
+  }
+  const OV5640_LatencyHist& h = ov5640.latency(OV5640_OP_MANUAL_FOCUS);
+  printf("%-28s mean=%6.2f ms p50<%6.2f ms p90<%6.2f ms txns=%5lu polls=%4lu\n",
+         name, h.meanUs() / 1000.0, h.percentileUs(50) / 1000.0,
+         h.percentileUs(90) / 1000.0, (unsigned long)sim.transactions,
+         (unsigned long)sim.pollReads);
+  meanUs = h.meanUs();
+  return sim.pollReads;
+}
+
+/* Small moves and repeated targets, with and without the register shadow */
+OV5640_BusStats cacheRun(bool enable) {
+  static const uint16_t steps[] = { 100, 100, 100, 356, 360, 364, 364, 612, 616, 616 };
+  ov5640.setRegisterCache(enable);
+  ov5640.resetCacheStats();
+  ov5640.getTransport()->resetStats();
+  begin();
+  for (uint8_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    ov5640.manualFocus(steps[i]);
+    ov5640.getFWStatus();
+  }
+  const OV5640_BusStats& b = ov5640.busStats();
+  const OV5640_CacheStats& c = ov5640.getCacheStats();
+  printf("%-28s writes=%3lu reads=%3lu txns=%4lu dropped=%lu sim=%6.2f ms\n",
+         enable ? "shadow on" : "shadow off", (unsigned long)b.writes,
+         (unsigned long)b.reads, (unsigned long)b.transactions,
+         (unsigned long)c.writesDropped, (sim.nowUs() - simStart) / 1000.0);
+  check(sim.lensPosition() == steps[sizeof(steps) / sizeof(steps[0]) - 1],
+        "%s: lens at %u", enable ? "shadow on" : "shadow off", sim.lensPosition());
+  return b;
+}
+
+void setup() {
+#if defined(ARDUINO)
+  Serial.begin(115200);
+  delay(1000);
+#endif
+  printf("\nOV5640 AF simulator benchmark\n\n");
+  ov5640.setClock(&sim);
+
+  /* Cold boot through the fake sensor_t: one transaction per byte */
+  const uint32_t fwBytes = sizeof(OV5640_AF_Config);
+  sim.powerOn();
+  ov5640.start(sim.sensor());
+  ov5640.getTransport()->resetStats();
+  begin();
+  uint8_t rc = ov5640.focusInit();
+  report("focusInit (sensor_t)", rc);
+  OV5640_BusStats perByte = ov5640.busStats();
+  check(rc == 0, "focusInit through sensor_t");
+  check(perByte.transactions >= fwBytes, "sensor_t: a transaction per firmware byte");
+
+  /* Cold boot with 64-byte sequential writes */
+  sim.powerOn();
+  ov5640.start(&simBus);
+  ov5640.getTransport()->resetStats();
+  begin();
+  rc = ov5640.focusInit();
+  report("focusInit (burst 64)", rc);
+  OV5640_BusStats burst = ov5640.busStats();
+  check(rc == 0, "focusInit through the burst transport");
+  check(burst.writes == perByte.writes && burst.reads == perByte.reads,
+        "burst: the same register bytes as sensor_t");
+  check(burst.transactions <= (fwBytes + 63) / 64 + (perByte.transactions - fwBytes),
+        "burst: a transaction per 64-byte chunk of firmware");
+  check(burst.bytes <= burst.writes + burst.reads + 2 * burst.transactions,
+        "burst: one register address per transaction");
+  printf("  upload: %lu -> %lu transactions, %lu -> %lu bytes on the bus\n",
+         (unsigned long)perByte.transactions, (unsigned long)burst.transactions,
+         (unsigned long)perByte.bytes, (unsigned long)burst.bytes);
+
+  /* Soft reboot of the ESP32: sensor stayed powered, firmware resident */
+  ov5640.getTransport()->resetStats();
+  begin();
+  rc = ov5640.focusInit();
+  report("focusInit (warm)", rc);
+  OV5640_BusStats warm = ov5640.busStats();
+  check(rc == 0 && ov5640.currentOp()->reused, "warm: resident firmware reused");
+  check(warm.writes == 0, "warm: %lu bytes written, want none", (unsigned long)warm.writes);
+  ov5640.getTransport()->resetStats();
+  begin();
+  rc = ov5640.focusInit(true);
+  report("focusInit (warm, forced)", rc);
+  check(rc == 0 && !ov5640.currentOp()->reused && ov5640.busStats().writes >= fwBytes,
+        "warm, forced: firmware uploaded again");
+
+  /* One probe byte of the resident image goes bad: the probe must notice */
+  const uint16_t probe = OV5640_FW_BASE + OV5640_Firmware::probeOffset(OV5640_FW_PROBES / 2);
+  sim.busWrite(probe, sim.peek(probe) ^ 0xFF);
+  ov5640.getTransport()->resetStats();
+  begin();
+  rc = ov5640.focusInit();
+  report("focusInit (probe corrupted)", rc);
+  check(rc == 0 && !ov5640.currentOp()->reused && ov5640.busStats().writes >= fwBytes,
+        "corrupted probe byte: firmware reloaded");
+  check(sim.peek(probe) == OV5640_AF_Config[probe - OV5640_FW_BASE], "corrupted probe byte: image restored");
+
+  sim.setSubjectStep(600);
+  begin();
+  report("autoFocusMode", ov5640.autoFocusMode());
+
+  uint8_t zones = 0;
+  begin();
+  report("setFocusPoint(0.5, 0.7)", ov5640.setFocusPoint(0.5f, 0.7f));
+  begin();
+  report("singleAutoFocus", ov5640.singleAutoFocus(&zones));
+  OV5640_FocusZone two[] = { { 0.1f, 0.1f, 0.2f, 0.2f }, { 0.6f, 0.6f, 0.3f, 0.3f } };
+  begin();
+  report("setFocusZones(2)", ov5640.setFocusZones(two, 2));
+  begin();
+  report("singleAutoFocus", ov5640.singleAutoFocus(&zones));
+  printf("  zones in focus: 0x%02x\n", zones);
+  begin();
+  report("setFocusZones(NULL, 0)", ov5640.setFocusZones(NULL, 0));
+
+  uint16_t steps[] = { 0, 1023, 512, 520 };
+  char name[32];
+  for (uint8_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    snprintf(name, sizeof(name), "manualFocus(%u)", steps[i]);
+    begin();
+    report(name, ov5640.manualFocus(steps[i]));
+  }
+
+  uint16_t dists[] = { 60, 120, 1000 };
+  for (uint8_t i = 0; i < sizeof(dists) / sizeof(dists[0]); i++) {
+    snprintf(name, sizeof(name), "manualFocusDistance(%u)", dists[i]);
+    begin();
+    report(name, ov5640.manualFocusDistance(dists[i]));
+  }
+
+  printf("\n50 random lens moves\n");
+  OV5640_PollPolicy fixed = { 0, 0, 5000, 1, 5000, 5000 };
+  uint32_t fixedMean, backoffMean;
+  uint32_t fixedReads = pollPolicyRun("fixed 5 ms", fixed, fixedMean);
+  uint32_t backoffReads = pollPolicyRun("spin + backoff (default)", OV5640::defaultPollPolicy(), backoffMean);
+  check(backoffReads <= fixedReads, "default poll policy: %lu status reads vs %lu fixed",
+        (unsigned long)backoffReads, (unsigned long)fixedReads);
+  check(backoffMean < fixedMean, "default poll policy: mean %lu us vs %lu us fixed",
+        (unsigned long)backoffMean, (unsigned long)fixedMean);
+
+  printf("\nAF register shadow, 10 moves\n");
+  OV5640_BusStats off = cacheRun(false);
+  OV5640_BusStats on = cacheRun(true);
+  /* every move still sends its command; only PARA3/4 equal to the bus are
+   * dropped: 12 of the 20 for these steps */
+  uint32_t dropped = ov5640.getCacheStats().writesDropped;
+  check(dropped == 12 && on.writes == off.writes - dropped, "shadow: %lu writes vs %lu without, %lu dropped",
+        (unsigned long)on.writes, (unsigned long)off.writes, (unsigned long)dropped);
+  check(on.transactions < off.transactions, "shadow: %lu transactions vs %lu without",
+        (unsigned long)on.transactions, (unsigned long)off.transactions);
+
+  check.summary();
+}
+
+void loop() {
+#if defined(ARDUINO)
+  delay(1000);
+#endif
+}
+
+#if !defined(ARDUINO)
+int main() {
+  setup();
+  return check.exitCode();
+}
+#endif
@@ -0,0 +1,234 @@
+/*
+  OV5640 telemetry benchmark
+  1. Floods OV5640_Telemetry with events while a second thread drains the
+     ring.  It prints the cost per event (mean, and the worst block of
+     1000 events).  The producer never yields, so most events are dropped.
+     The point is that the cost stays bounded when the ring is full.
+  2. With the library built with OV5640_TELEMETRY=1, runs focusInit,
+     continuous AF, lens moves, a single-shot AF and one forced timeout on
+     the simulator in real time while another thread drains the events.
+     It prints the counters, the first events, and the cost of the hooks
+     on a manual move.
+
+  On a glibc host, every heap allocation (malloc and new) is counted.
+  Exits non-zero unless both runs make 0 allocations, every event is
+  either drained or counted as dropped, the counters match the events and
+  operations that were run, and a second camera cannot attach to a ring
+  that already has one.  The timings are printed, not checked.
+
+  Also builds on a Linux host, with and without the hooks:
+    g++ -std=gnu++11 -O2 -DOV5640_TELEMETRY=1 -Isrc -x c++ examples/OV5640_TelemetryBench/OV5640_TelemetryBench.ino -x none src/ESP32_OV5640_*.cpp -lpthread
+*/
+
+#include <stdio.h>
+#include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_sim.h"
+#include "ESP32_OV5640_check.h"
+#include "ESP32_OV5640_telemetry.h"
+
+#if !defined(ARDUINO)
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#if defined(__GLIBC__)
+/* Count every allocation, new included, by wrapping glibc's malloc */
+extern "C" void* __libc_malloc(size_t);
+static std::atomic<uint32_t> allocations(0);
+extern "C" void* malloc(size_t n) {
+  allocations++;
+  return __libc_malloc(n);
+}
+#define ALLOCATIONS() allocations.load()
+#else
+#define ALLOCATIONS() 0u
+#endif
+
+static uint64_t nowNs() {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/* Drains tel on its own thread until stopped */
+class Drain {
+public:
+  Drain(OV5640_Telemetry& _tel) : tel(_tel), stop(false), got(0) {
+    worker = std::thread(&Drain::run, this);
+  }
+  uint32_t finish() {
+    stop = true;
+    worker.join();
+    OV5640_Event e;
+    while (tel.read(e)) got++;
+    return got;
+  }
+
+private:
+  void run() {
+    OV5640_Event batch[32];
+    while (!stop) {
+      uint32_t n = tel.read(batch, 32);
+      got += n;
+      if (!n) std::this_thread::yield();
+    }
+  }
+
+  OV5640_Telemetry& tel;
+  std::atomic<bool> stop;
+  uint32_t got;
+  std::thread worker;
+};
+#endif
+
+#define EVENTS    1000000
+#define BLOCK     1000
+
+OV5640_Telemetry tel;
+OV5640_Sim sim;
+OV5640_SimTransport simBus(sim, 64);
+OV5640 ov5640 = OV5640();
+OV5640_Check check;
+
+void ringBench() {
+#if !defined(ARDUINO)
+  tel.resetCounters();
+  Drain drain(tel);
+  uint32_t allocs = ALLOCATIONS();
+
+  uint64_t worst = 0;
+  uint64_t t0 = nowNs();
+  for (uint32_t i = 0; i < EVENTS; i += BLOCK) {
+    uint64_t b = nowNs();
+    for (uint32_t k = 0; k < BLOCK; k++) tel.record(OV5640_EVT_LENS, k & 0x3ff, i, i);
+    b = nowNs() - b;
+    if (b > worst) worst = b;
+  }
+  uint64_t total = nowNs() - t0;
+  allocs = ALLOCATIONS() - allocs;
+
+  uint32_t drained = drain.finish();
+  OV5640_TelemetryCounters c = tel.counters();
+  printf("ring flood: %u events, mean %.1f ns/event, worst block %.1f ns/event\n",
+         EVENTS, (double)total / EVENTS, (double)worst / BLOCK);
+  printf("      drained %lu, dropped %lu (ring %u), allocations %lu\n",
+         (unsigned long)drained, (unsigned long)c.dropped, OV5640_TELEMETRY_RING,
+         (unsigned long)allocs);
+  check(allocs == 0, "ring flood: no allocations");
+  check(drained + c.dropped == EVENTS, "ring flood: every event drained or dropped");
+  check(c.events == EVENTS && c.lensMoves == EVENTS, "ring flood: %lu events, %lu lens moves counted",
+        (unsigned long)c.events, (unsigned long)c.lensMoves);
+#endif
+}
+
+/* Wall time per manual move through the simulator */
+double moveNs(uint32_t moves) {
+#if !defined(ARDUINO)
+  uint64_t t0 = nowNs();
+  for (uint32_t i = 0; i < moves; i++) ov5640.manualFocus((i * 37) & 0x3ff);
+  return (double)(nowNs() - t0) / moves;
+#else
+  return 0;
+#endif
+}
+
+void afBench() {
+  if (!OV5640::telemetryBuilt()) {
+    printf("\nAF hooks: library built without OV5640_TELEMETRY=1, nothing recorded\n");
+    return;
+  }
+#if !defined(ARDUINO)
+  OV5640_SimConfig cfg = OV5640_Sim::defaultConfig();
+  cfg.realTime = true;                  // AF ops take as long as on the sensor
+  sim.configure(cfg);
+  ov5640.setClock(&sim);
+  sim.powerOn();
+  ov5640.start(&simBus);
+
+  tel.resetCounters();
+  check(ov5640.setTelemetry(&tel), "attach: first camera");
+  OV5640 other = OV5640();
+  check(!other.setTelemetry(&tel) && !other.getTelemetry() && tel.owner() == &ov5640,
+        "attach: a second camera is refused");
+  Drain drain(tel);
+  uint32_t allocs = ALLOCATIONS();
+
+  ov5640.focusInit();
+  ov5640.autoFocusMode();
+  for (uint16_t i = 0; i < 100; i++) ov5640.manualFocus((i * 97) & 0x3ff);
+  ov5640.singleAutoFocus();
+
+  /* a wait that cannot finish in time */
+  OV5640_PollPolicy p = OV5640::defaultPollPolicy();
+  OV5640_PollPolicy tight = p;
+  tight.timeoutMs = 1;
+  ov5640.setPollPolicy(tight);
+  uint8_t rc = ov5640.singleAutoFocus();
+  ov5640.setPollPolicy(p);
+
+  allocs = ALLOCATIONS() - allocs;
+  uint32_t drained = drain.finish();
+  OV5640_TelemetryCounters c = tel.counters();
+  printf("\nAF run (forced timeout rc=%u), allocations %lu, drained %lu\n",
+         rc, (unsigned long)allocs, (unsigned long)drained);
+  printf("  ops %lu failures %lu commands %lu acks %lu (mean %.2f ms) status changes %lu\n",
+         (unsigned long)c.ops, (unsigned long)c.failures, (unsigned long)c.commands,
+         (unsigned long)c.acks, c.acks ? c.ackWaitUs / 1000.0 / c.acks : 0.0,
+         (unsigned long)c.statusChanges);
+  printf("  lens moves %lu bus transactions %lu timeouts %lu events %lu dropped %lu\n",
+         (unsigned long)c.lensMoves, (unsigned long)c.busTransactions,
+         (unsigned long)c.timeouts, (unsigned long)c.events, (unsigned long)c.dropped);
+  check(allocs == 0, "AF run: no allocations");
+  check(drained + c.dropped == c.events, "AF run: every event drained or dropped");
+  check(rc == OV5640_ERR_TIMEOUT && c.timeouts == 1, "AF run: the forced timeout recorded");
+  /* focusInit, autoFocusMode, 100 moves and two single-shot AFs */
+  check(c.ops == 104 && c.failures == 1 && c.lensMoves == 100,
+        "AF run: %lu ops, %lu failed, %lu lens moves", (unsigned long)c.ops,
+        (unsigned long)c.failures, (unsigned long)c.lensMoves);
+  check(c.acks <= c.commands, "AF run: %lu acks for %lu commands", (unsigned long)c.acks,
+        (unsigned long)c.commands);
+
+  /* the first events of a fresh run */
+  tel.resetCounters();
+  ov5640.autoFocusMode();
+  ov5640.manualFocus(300);
+  OV5640_Event e;
+  printf("\n  %10s  %-9s %6s %8s\n", "sim us", "event", "arg", "value");
+  while (tel.read(e))
+    printf("  %10lu  %-9s 0x%04x %8lu\n", (unsigned long)e.us,
+           OV5640_Telemetry::eventName(e.type), e.arg, (unsigned long)e.value);
+
+  /* hook cost: the same moves with and without a sink attached */
+  cfg.realTime = false;
+  sim.configure(cfg);
+  ov5640.setTelemetry(NULL);
+  double off = moveNs(20000);
+  ov5640.setTelemetry(&tel);
+  double on = moveNs(20000);
+  ov5640.setTelemetry(NULL);
+  check(other.setTelemetry(&tel) && other.setTelemetry(NULL), "attach: free again once detached");
+  printf("\nmanual move on the simulator: %.0f ns without telemetry, %.0f ns with (%+.0f ns)\n",
+         off, on, on - off);
+#endif
+}
+
+void setup() {
+#if defined(ARDUINO)
+  Serial.begin(115200);
+#endif
+  ringBench();
+  afBench();
+  check.summary();
+}
+
+void loop() {
+#if defined(ARDUINO)
+  delay(1000);
+#endif
+}
+
+#if !defined(ARDUINO)
+int main() {
+  setup();
+  return check.exitCode();
+}
+#endif
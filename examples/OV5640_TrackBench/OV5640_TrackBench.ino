@@ -0,0 +1,166 @@
+/*
+  OV5640 predictive focus tracking benchmark
+  A simulated subject approaches the camera for 10 s.  Compares the
+  firmware's continuous AF, a full software AF search every cycle and
+  OV5640_Tracker (narrow search around the prediction, lens following the
+  prediction between searches).  Prints the lens error over all frames,
+  the time to lock and, for the tracker, the prediction error, and checks
+  that the tracker keeps the lens closer than continuous AF.
+
+  Also builds on a Linux host:
+    g++ -std=gnu++11 -O2 -Isrc -x c++ examples/OV5640_TrackBench/OV5640_TrackBench.ino -x none src/ESP32_OV5640_*.cpp -lpthread
+*/
+
+#include <stdio.h>
+#include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_sim.h"
+#include "ESP32_OV5640_softaf.h"
+#include "ESP32_OV5640_track.h"
+#include "ESP32_OV5640_check.h"
+
+#define W 160
+#define H 120
+#define RUN_US 10000000UL
+#define FRAMES_PER_CYCLE 10
+
+OV5640_Check check;
+OV5640_Sim sim;
+OV5640_SimTransport simBus(sim, 64);
+OV5640 ov5640 = OV5640();
+uint8_t frameBuf[W * H];
+OV5640_SimFrameSource simFrames(sim, frameBuf, W, H);
+
+/* Passes frames through and records how far the lens is off the subject */
+class ErrorProbe : public OV5640_FrameSource {
+public:
+  ErrorProbe(OV5640_FrameSource& _src) : src(_src) { clear(); }
+  void clear() { frames = errSum = errMax = 0; }
+  virtual bool grab(OV5640_Frame& frame) {
+    uint16_t lens = sim.lensPosition(), subject = sim.getSubjectStep();
+    uint32_t err = lens > subject ? lens - subject : subject - lens;
+    errSum += err;
+    if (err > errMax) errMax = err;
+    frames++;
+    return src.grab(frame);
+  }
+  virtual void release(OV5640_Frame& frame) { src.release(frame); }
+  uint32_t frames, errSum, errMax;
+private:
+  OV5640_FrameSource& src;
+};
+
+ErrorProbe frames(simFrames);
+OV5640_SoftAF softAF(ov5640, frames);
+
+enum Mode { CONTINUOUS, FULL_SEARCH, TRACKER };
+
+struct Motion {
+  const char* name;
+  uint16_t from;
+  float v1, v2;           // steps/s for the first and second half
+};
+
+void grabFrames(uint8_t n, OV5640_Tracker* tracker) {
+  for (uint8_t i = 0; i < n; i++) {
+    OV5640_Frame f;
+    if (tracker) tracker->follow();
+    frames.grab(f);
+    frames.release(f);
+    if (!tracker) ov5640.getFWStatus();
+  }
+}
+
+/* Returns the mean lens error over all frames */
+double run(const Motion& m, const char* name, Mode mode) {
+  sim.powerOn();
+  ov5640.start(&simBus);
+  ov5640.focusInit();
+  ov5640.manualFocus(m.from);
+  sim.setSubjectVelocity(0);
+  sim.setSubjectStep(m.from);
+
+  /* every mode starts in focus */
+  OV5640_Tracker tracker(softAF);
+  tracker.addLock(m.from, sim.nowUs());
+  uint32_t lockUs = 0, locks = 0;
+  frames.clear();
+  sim.resetCounters();
+
+  uint32_t t0 = sim.nowUs();
+  bool secondHalf = false;
+  sim.setSubjectVelocity(m.v1);
+  if (mode == CONTINUOUS) ov5640.autoFocusMode();
+
+  while (sim.nowUs() - t0 < RUN_US) {
+    if (!secondHalf && sim.nowUs() - t0 >= RUN_US / 2) {
+      sim.setSubjectVelocity(m.v2);
+      secondHalf = true;
+    }
+    if (mode == FULL_SEARCH) {
+      OV5640_SoftAFResult res;
+      softAF.run(&res);
+      lockUs += res.timeUs;
+      locks++;
+      grabFrames(FRAMES_PER_CYCLE, NULL);
+    } else if (mode == TRACKER) {
+      tracker.relock();
+      grabFrames(FRAMES_PER_CYCLE, &tracker);
+    } else {
+      grabFrames(1, NULL);
+    }
+  }
+
+  if (mode == CONTINUOUS) {
+    locks = sim.afSearches;
+    lockUs = locks * sim.config().afSearchUs;
+  } else if (mode == TRACKER) {
+    locks = tracker.stats().relocks;
+    lockUs = tracker.stats().meanLockUs() * locks;
+  }
+  printf("  %-16s lens error mean=%5.1f max=%4lu  locks=%3lu lock=%6.1f ms  txns=%5lu",
+         name, (double)frames.errSum / frames.frames, (unsigned long)frames.errMax,
+         (unsigned long)locks, locks ? lockUs / 1000.0 / locks : 0.0,
+         (unsigned long)sim.transactions);
+  if (mode == TRACKER)
+    printf("  pred err=%3u lost=%lu v=%.0f/s", tracker.stats().meanAbsError(),
+           (unsigned long)tracker.stats().lost, tracker.velocity());
+  printf("\n");
+  sim.setSubjectVelocity(0);
+  return (double)frames.errSum / frames.frames;
+}
+
+void setup() {
+#if defined(ARDUINO)
+  Serial.begin(115200);
+  delay(1000);
+#endif
+  printf("\nOV5640 predictive focus tracking benchmark (10 s, 30 fps)\n");
+  ov5640.setClock(&sim);
+
+  const Motion motions[] = {
+    { "steady approach, 60 steps/s", 200, 60, 60 },
+    { "speeding up, 20 then 100 steps/s", 200, 20, 100 },
+    { "approach then retreat, +/-80 steps/s", 300, 80, -80 },
+  };
+  for (uint8_t i = 0; i < sizeof(motions) / sizeof(motions[0]); i++) {
+    printf("\n%s\n", motions[i].name);
+    double caf = run(motions[i], "continuous AF", CONTINUOUS);
+    run(motions[i], "full SoftAF", FULL_SEARCH);
+    double tracked = run(motions[i], "tracker", TRACKER);
+    check(tracked < caf, "%s: tracker error %.1f vs %.1f for continuous AF", motions[i].name, tracked, caf);
+  }
+  check.summary();
+}
+
+void loop() {
+#if defined(ARDUINO)
+  delay(1000);
+#endif
+}
+
+#if !defined(ARDUINO)
+int main() {
+  setup();
+  return check.exitCode();
+}
+#endif
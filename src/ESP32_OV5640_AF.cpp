@@ -5,130 +5,634 @@
 */
 
 #include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_focuscal.h"
 
-OV5640::OV5640() {
+/* Telemetry hooks, compiled out unless OV5640_TELEMETRY is set */
+#if OV5640_TELEMETRY
+#define OV5640_NOTE(...)                  note(__VA_ARGS__)
+#define OV5640_NOTE_STATUS(st)            noteStatus(st)
+#else
+#define OV5640_NOTE(...)                  do {} while (0)
+#define OV5640_NOTE_STATUS(st)            do {} while (0)
+#endif
+
+OV5640::OV5640() : core(OV5640_CameraBus(&sccb, &sccb)) {
+  bus = &sccb;
+  clock = OV5640_Clock::system();
+  burstSize = OV5640_BURST_DEFAULT;
   isOV5640 = false;
+  memset(&op, 0, sizeof(op));
+  focusCal = &OV5640_FocusCal::defaults();
+  cacheOn = true;
+  zoneCount = 0;
+  tel = NULL;
+  telTxns = 0;
+  telStatus = OV5640_FW_STATUS_UNKNOWN;
+  afInvalidate();
+  resetCacheStats();
+  resetSequenceStats();
+  clearLatency();
+}
+
+OV5640::~OV5640() {
+  setTelemetry(NULL);
 }
 
 bool OV5640::start(sensor_t* _sensor) {
-  sensor = _sensor;
-  uint8_t vid, pid;
-  vid = sensor->get_reg(sensor, OV5640_CHIPID_HIGH, 0xff);
-  pid = sensor->get_reg(sensor, OV5640_CHIPID_LOW, 0xff);
+  sccb.begin(_sensor);
+  return start(&sccb);
+}
 
-  isOV5640 = (vid == 0x56) && (pid == 0x40);
+bool OV5640::start(OV5640_Transport* transport) {
+#if OV5640_SCCB_ONLY
+  if (transport != &sccb) {                      // not compiled in
+    isOV5640 = false;
+    return false;
+  }
+#endif
+  bus = transport;
+  core.bus() = OV5640_CameraBus(transport, transport == &sccb ? &sccb : NULL);
+  afInvalidate();
+  isOV5640 = core.probe();
   return isOV5640;
 }
 
-uint8_t OV5640::focusInit() {
-  if (!isOV5640) return -1;
-
-  uint16_t i;
-  uint16_t addr = 0x8000;
-  uint8_t state = 0x8F;
-  uint8_t rc = 0;
-  rc = sensor->set_reg(sensor, 0x3000, 0xff, 0x20);  //reset
-  if (rc < 0) return -1;
-
-  for (i = 0; i < sizeof(OV5640_AF_Config); i++) {
-    rc = sensor->set_reg(sensor, addr, 0xff, OV5640_AF_Config[i]);
-    if (rc < 0) return -1;
-
-    addr++;
-  }
-
-  sensor->set_reg(sensor, OV5640_CMD_MAIN, 0xff, 0x00);
-  sensor->set_reg(sensor, OV5640_CMD_ACK, 0xff, 0x00);
-  sensor->set_reg(sensor, OV5640_CMD_PARA0, 0xff, 0x00);
-  sensor->set_reg(sensor, OV5640_CMD_PARA1, 0xff, 0x00);
-  sensor->set_reg(sensor, OV5640_CMD_PARA2, 0xff, 0x00);
-  sensor->set_reg(sensor, OV5640_CMD_PARA3, 0xff, 0x00);
-  sensor->set_reg(sensor, OV5640_CMD_PARA4, 0xff, 0x00);
-  sensor->set_reg(sensor, OV5640_CMD_FW_STATUS, 0xff, 0x7f);
-  sensor->set_reg(sensor, 0x3000, 0xff, 0x00);
-
-  i = 0;
-  do {
-    state = sensor->get_reg(sensor, 0x3029, 0xff);
-    delay(5);
-    i++;
-    if (i > 1000) return 1;
-  } while (state != FW_STATUS_S_IDLE);
-
-  return 0;
-}
-
-/* Coarse linear LUT {distance [mm] , VCM step} – last entry (∞) is 0 */
-static const struct { uint16_t d; uint16_t step; } dist_lut[] PROGMEM = {
-  { 50 , 1023 },   // 5 cm  (closest)
-  { 70 , 850  },
-  {100 , 680  },
-  {150 , 540  },
-  {250 , 400  },
-  {400 , 260  },
-  {800 , 120  },
-  {  0 ,   0  }    // 0 = default => infinity
-};
+uint8_t OV5640::focusInit(bool forceReload) {
+  if (!isOV5640) return OV5640_ERR_NOT_OV5640;
+  wait();                               // let an async op in flight finish
+  focusInitAsync(NULL, NULL, forceReload);
+  return wait();
+}
+
+bool OV5640::firmwareResident() {
+  return isOV5640 && core.firmwareResident();
+}
 
 uint8_t OV5640::manualFocus(uint16_t step)
 {
-  if (!isOV5640) return 2;
-  step &= 0x03FF;                       // 10-bit range
+  if (!isOV5640) return OV5640_ERR_NOT_OV5640;
+  wait();
+  manualFocusAsync(step);
+  return wait();
+}
+
+uint8_t OV5640::manualFocusDistance(uint16_t distance_mm)
+{
+  return manualFocus(focusCal->stepFor(distance_mm));
+}
+
+uint8_t OV5640::autoFocusMode() {
+  if (!isOV5640) return OV5640_ERR_NOT_OV5640;
+  wait();
+  autoFocusModeAsync();
+  return wait();
+}
+
+uint8_t OV5640::playSequence(const OV5640_SeqOp* seq, size_t n) {
+  if (!isOV5640) return OV5640_ERR_NOT_OV5640;
+  wait();
+  if (!playSequenceAsync(seq, n)) return OV5640_ERR_NOT_OV5640;
+  return wait();
+}
+
+uint8_t OV5640::getFWStatus() {
+  if (!isOV5640) return OV5640_FW_STATUS_UNKNOWN;
+  /* no telemetry here: the ring has one producer, whatever calls poll() */
+  int st = afRead(OV5640_CMD_FW_STATUS);
+  if (st < 0) return OV5640_FW_STATUS_UNKNOWN;
+  return st;
+}
+
+/********************  Non-blocking API  ********************/
+
+const OV5640_AsyncOp* OV5640::focusInitAsync(OV5640_OpCallback cb, void* ctx, bool forceReload) {
+  if (!startOp(OV5640_OP_FOCUS_INIT, cb, ctx)) return NULL;
+  if (forceReload) op.phase = 1;        // skip the resident-firmware check
+  return &op;
+}
+
+const OV5640_AsyncOp* OV5640::autoFocusModeAsync(OV5640_OpCallback cb, void* ctx) {
+  if (!startOp(OV5640_OP_AUTO_FOCUS, cb, ctx)) return NULL;
+  op.seq = OV5640_SEQ_AF_CONTINUOUS;
+  op.seqLen = sizeof(OV5640_SEQ_AF_CONTINUOUS) / sizeof(OV5640_SEQ_AF_CONTINUOUS[0]);
+  return &op;
+}
+
+const OV5640_AsyncOp* OV5640::playSequenceAsync(const OV5640_SeqOp* seq, size_t n,
+                                                OV5640_OpCallback cb, void* ctx) {
+  if (!seq || n > 0xFFFF) return NULL;
+  if (!startOp(OV5640_OP_SEQUENCE, cb, ctx)) return NULL;
+  op.seq = seq;
+  op.seqLen = n;
+  return &op;
+}
+
+const OV5640_AsyncOp* OV5640::manualFocusAsync(uint16_t step, OV5640_OpCallback cb, void* ctx) {
+  if (!startOp(OV5640_OP_MANUAL_FOCUS, cb, ctx)) return NULL;
+  op.step = step & 0x03FF;              // 10-bit range
+  return &op;
+}
+
+bool OV5640::poll() {
+  if (op.state != OV5640_OP_RUNNING) return false;
+  if ((int32_t)(clock->nowUs() - op.pollAt) < 0) return true;
+
+  switch (op.type) {
+    case OV5640_OP_FOCUS_INIT:   stepFocusInit();   break;
+    case OV5640_OP_AUTO_FOCUS:   stepAutoFocus();   break;
+    case OV5640_OP_MANUAL_FOCUS: stepManualFocus(); break;
+    case OV5640_OP_ZONE_CONFIG:  stepZoneConfig();  break;
+    case OV5640_OP_SINGLE_FOCUS: stepSingleFocus(); break;
+    case OV5640_OP_SEQUENCE:     if (stepSeq()) finishOp(0); break;
+    default:                     finishOp(OV5640_ERR_NOT_OV5640); break;
+  }
+  return op.state == OV5640_OP_RUNNING;
+}
+
+bool OV5640::startOp(OV5640_OpType type, OV5640_OpCallback cb, void* ctx) {
+  if (!isOV5640 || op.state == OV5640_OP_RUNNING) return false;
+
+  memset(&op, 0, sizeof(op));
+  op.type = type;
+  op.state = OV5640_OP_RUNNING;
+  op.startUs = clock->nowUs();
+  op.pollAt = op.startUs;
+  op.cb = cb;
+  op.ctx = ctx;
+#if OV5640_TELEMETRY
+  telTxns = bus->stats().transactions;
+#endif
+  OV5640_NOTE(OV5640_EVT_OP_START, type);
+  return true;
+}
+
+void OV5640::finishOp(uint8_t rc) {
+  op.result = rc;
+  op.state = OV5640_OP_DONE;
+  op.doneUs = clock->nowUs();
+  OV5640_NOTE(OV5640_EVT_BUS, op.type, bus->stats().transactions - telTxns);
+  OV5640_NOTE(OV5640_EVT_OP_DONE, op.type << 8 | rc, op.doneUs - op.startUs);
+  if (rc == 0)
+    hist[op.type].add(op.doneUs - op.startUs);
+  else
+    hist[op.type].timeouts++;
+  if (op.cb) op.cb(this, &op, op.ctx);
+}
+
+/* Blocking drain of the current op, used by the synchronous calls */
+uint8_t OV5640::wait() {
+  while (poll()) {
+    int32_t dt = (int32_t)(op.pollAt - clock->nowUs());
+    if (dt > 0) clock->sleepUs(dt);
+  }
+  return op.result;
+}
+
+/**
+ * One status read through the core.  true once reg == value; otherwise
+ * schedules the next read per the poll policy, or finishes the op with
+ * timeoutRc once the wait has run for timeoutMs (OV5640_ERR_BUS if the
+ * read failed).
+ */
+bool OV5640::waitReg(uint16_t reg, uint8_t value, uint8_t timeoutRc,
+                     uint8_t mask, uint32_t timeoutMs) {
+  OV5640_PollState& w = op.waitState;
+  uint8_t rc;
+  bool over = core.pollReg(w, reg, value, timeoutRc, rc, mask, timeoutMs);
+  if (reg == OV5640_CMD_FW_STATUS) OV5640_NOTE_STATUS(w.value);
+  if (!over) {
+    op.pollAt = w.nextUs;
+    return false;
+  }
+
+  if (rc == OV5640_OK && reg == OV5640_CMD_ACK)
+    OV5640_NOTE(OV5640_EVT_ACK, w.polls + 1, w.polls ? clock->nowUs() - w.startUs : 0);
+  else if (rc == timeoutRc && rc)
+    OV5640_NOTE(OV5640_EVT_TIMEOUT, reg, clock->nowUs() - w.startUs);
+  memset(&w, 0, sizeof(w));
+  if (rc) finishOp(rc);
+  return rc == OV5640_OK;
+}
+
+void OV5640::stepFocusInit() {
+  uint16_t chunk, n;
+
+  switch (op.phase) {
+    case 0:
+      if (firmwareResident()) {
+        op.reused = true;
+        finishOp(0);
+        return;
+      }
+      op.phase++;
+      break;
+
+    case 1:
+      afInvalidate();
+      if (core.holdMCU() < 0) {                      //reset
+        finishOp(OV5640_ERR_BUS);
+        return;
+      }
+      op.phase++;
+      break;
+
+    case 2:
+      /* One chunk per poll so the caller keeps running during the upload;
+       * sequential transactions when the transport has them, else per byte */
+      chunk = burstSize ? burstSize : core.bus().maxBurst();
+      if (chunk == 0) chunk = OV5640_BURST_DEFAULT;
+      n = OV5640_Firmware::size() - op.offset;
+      if (n > chunk) n = chunk;
+      if (core.uploadFirmware(op.offset, n, burstSize) < 0) {
+        finishOp(OV5640_ERR_BUS);
+        return;
+      }
+      op.offset += n;
+      if (op.offset >= OV5640_Firmware::size()) op.phase++;
+      break;
+
+    case 3:
+      op.seq = OV5640_SEQ_FW_RELEASE;
+      op.seqLen = sizeof(OV5640_SEQ_FW_RELEASE) / sizeof(OV5640_SEQ_FW_RELEASE[0]);
+      op.phase++;
+      /* fall through */
+
+    default:
+      if (stepSeq()) finishOp(0);
+      break;
+  }
+}
 
-  /* Write high / low parts of the desired position */
-  sensor->set_reg(sensor, OV5640_CMD_PARA3, 0xFF, step >> 8);
-  sensor->set_reg(sensor, OV5640_CMD_PARA4, 0xFF, step & 0xFF);
+void OV5640::stepAutoFocus() {
+  if (stepSeq()) finishOp(0);
+}
+
+/*
+ * One unit of a register sequence per call: the writes up to the next
+ * wait or delay, one status read of a wait, or scheduling a delay.
+ * true once the sequence is through; a timed out wait or a bus error
+ * finishes the op instead.
+ */
+bool OV5640::stepSeq() {
+  if (op.seqPos >= op.seqLen) return true;
+
+  const OV5640_SeqOp& s = op.seq[op.seqPos];
+  size_t pos;
+  switch (s.op) {
+    case OV5640_SEQ_WAIT:
+      if (!waitReg(s.reg, s.val, OV5640_ERR_TIMEOUT, s.mask, s.ms)) return false;
+      op.seqPos++;
+      break;
+
+    case OV5640_SEQ_DELAY:
+      op.pollAt = clock->nowUs() + s.ms * 1000UL;
+      op.seqPos++;
+      return false;
+
+    case OV5640_SEQ_END:
+      op.seqPos = op.seqLen;
+      break;
+
+    case OV5640_SEQ_WRITE:
+    case OV5640_SEQ_MASK:
+    case OV5640_SEQ_UNORDERED:
+      /* the player writes past the shadow: flush it first, forget it after */
+      afFlush();
+      pos = op.seqPos;
+      if (core.playWrites(op.seq, op.seqLen, pos, &seqCounters) < 0) {
+        afInvalidate();
+        finishOp(OV5640_ERR_BUS);
+        return false;
+      }
+      afInvalidate();
+#if OV5640_TELEMETRY
+      for (size_t i = op.seqPos; i < pos; i++)
+        if (op.seq[i].reg == OV5640_CMD_MAIN) note(OV5640_EVT_COMMAND, op.seq[i].val);
+#endif
+      op.seqPos = pos;
+      break;
+
+    default:
+      finishOp(OV5640_ERR_NOT_OV5640);  // not an opcode
+      return false;
+  }
+  return op.seqPos >= op.seqLen;
+}
+
+void OV5640::stepManualFocus() {
+  if (op.phase == 0) {
+    /* Write high / low parts of the desired position */
+    afParam(OV5640_CMD_PARA3, op.step >> 8);
+    afParam(OV5640_CMD_PARA4, op.step & 0xFF);
 
-  /* Kick the internal MCU – 0x05 = “move lens to PARA3/4” */
-  sensor->set_reg(sensor, OV5640_CMD_MAIN, 0xFF, AF_MOVE_LENS);
+    /* Kick the internal MCU – 0x05 = “move lens to PARA3/4” */
+    if (issue(AF_MOVE_LENS)) op.phase++;
+    return;
+  }
 
   /* Wait for ACK to clear */
-  uint16_t retry = 0;
-  while (sensor->get_reg(sensor, OV5640_CMD_ACK, 0xFF) && retry++ < 1000)
-    delay(5);
+  if (waitReg(OV5640_CMD_ACK, 0x00, OV5640_ERR_TIMEOUT)) {
+    OV5640_NOTE(OV5640_EVT_LENS, op.step);
+    finishOp(0);
+  }
+}
 
-  return (retry >= 1000) ? 1 : 0;
+/********************  Telemetry  ********************/
+
+bool OV5640::telemetryBuilt() {
+  return OV5640_TELEMETRY != 0;
 }
 
-uint8_t OV5640::manualFocusDistance(uint16_t distance_mm)
-{
-  /* Find nearest entry in LUT */
-  uint16_t step = 0;
-  for (uint8_t i = 0; dist_lut[i].d; ++i) {
-    if (distance_mm <= dist_lut[i].d) { step = dist_lut[i].step; break; }
+bool OV5640::setTelemetry(OV5640_Telemetry* _tel) {
+  if (_tel && !_tel->attach(this)) return false;
+  if (tel && tel != _tel) tel->detach(this);
+  tel = _tel;
+  return true;
+}
+
+void OV5640::note(uint8_t type, uint16_t arg, uint32_t value) {
+  if (tel) tel->record(type, arg, value, clock->nowUs());
+}
+
+void OV5640::noteStatus(int status) {
+  if (status < 0 || status == telStatus) return;
+  note(OV5640_EVT_STATUS, telStatus << 8 | status);
+  telStatus = status;
+}
+
+/********************  Polling and latency  ********************/
+
+void OV5640::clearLatency() {
+  for (uint8_t i = 0; i < OV5640_OP_COUNT; i++)
+    hist[i].clear();
+}
+
+void OV5640_LatencyHist::clear() {
+  memset(this, 0, sizeof(*this));
+  minUs = 0xFFFFFFFF;
+}
+
+void OV5640_LatencyHist::add(uint32_t us) {
+  uint8_t i = 0;
+  while (i < OV5640_HIST_BUCKETS - 1 && us >= bucketLimitUs(i)) i++;
+  count[i]++;
+  samples++;
+  sumUs += us;
+  if (us < minUs) minUs = us;
+  if (us > maxUs) maxUs = us;
+}
+
+uint32_t OV5640_LatencyHist::bucketLimitUs(uint8_t i) {
+  if (i >= OV5640_HIST_BUCKETS - 1) return 0;
+  /* odd buckets sit at sqrt(2) ~ 181/128 of the even bound below */
+  uint32_t base = i & 1 ? OV5640_HIST_MIN_US * 181 / 128 : OV5640_HIST_MIN_US;
+  return base << (i >> 1);
+}
+
+uint32_t OV5640_LatencyHist::percentileUs(uint8_t pct) const {
+  if (!samples) return 0;
+  uint64_t want = ((uint64_t)samples * pct + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < OV5640_HIST_BUCKETS; i++) {
+    seen += count[i];
+    if (seen >= want) return bucketLimitUs(i) ? bucketLimitUs(i) : maxUs;
   }
-  return manualFocus(step);
+  return maxUs;
 }
 
+void OV5640::setFocusCalibration(const OV5640_FocusCal* cal) {
+  focusCal = cal ? cal : &OV5640_FocusCal::defaults();
+}
 
-uint8_t OV5640::autoFocusMode() {
-  if (!isOV5640) return -1;
-
-  uint8_t rc = 0;
-  uint8_t temp = 0;
-  uint16_t retry = 0;
-  rc = sensor->set_reg(sensor, OV5640_CMD_MAIN, 0xff, 0x01);
-  rc = sensor->set_reg(sensor, OV5640_CMD_MAIN, 0xff, 0x08);
-  do {
-    temp = sensor->get_reg(sensor, OV5640_CMD_ACK, 0xff);
-    retry++;
-    if (retry > 1000) return 2;
-    delay(5);
-  } while (temp != 0x00);
-  rc = sensor->set_reg(sensor, OV5640_CMD_ACK, 0xff, 0x01);
-  rc = sensor->set_reg(sensor, OV5640_CMD_MAIN, 0xff, AF_CONTINUE_AUTO_FOCUS);
-  retry = 0;
-  do {
-    temp = sensor->get_reg(sensor, OV5640_CMD_ACK, 0xff);
-    retry++;
-    if (retry > 1000) return 2;
-    delay(5);
-  } while (temp != 0x00);
-  return 0;
+/********************  Focus zones  ********************/
+
+uint8_t OV5640::setFocusZones(const OV5640_FocusZone* zones, uint8_t count) {
+  if (!isOV5640) return OV5640_ERR_NOT_OV5640;
+  wait();
+  if (!setFocusZonesAsync(zones, count)) return OV5640_ERR_NOT_OV5640;
+  return wait();
 }
 
-uint8_t OV5640::getFWStatus() {
-  if (!isOV5640) return -1;
-  uint8_t rc = sensor->get_reg(sensor, OV5640_CMD_FW_STATUS, 0xff);
+uint8_t OV5640::setFocusPoint(float x, float y) {
+  OV5640_FocusZone z = { x, y, 0, 0 };
+  return setFocusZones(&z, 1);
+}
+
+uint8_t OV5640::singleAutoFocus(uint8_t* zonesFocused) {
+  if (!isOV5640) return OV5640_ERR_NOT_OV5640;
+  wait();
+  singleAutoFocusAsync();
+  uint8_t rc = wait();
+  if (zonesFocused) *zonesFocused = op.zones;
+  return rc;
+}
+
+uint8_t OV5640::focusAt(float x, float y, uint8_t* zonesFocused) {
+  uint8_t rc = setFocusPoint(x, y);
+  if (rc) return rc;
+  return singleAutoFocus(zonesFocused);
+}
+
+static uint8_t zoneCoord(float v, uint8_t grid) {
+  if (v <= 0) return 0;
+  if (v >= 1) return grid - 1;
+  return (uint8_t)(v * grid);
+}
+
+const OV5640_AsyncOp* OV5640::setFocusZonesAsync(const OV5640_FocusZone* zones, uint8_t count,
+                                                 OV5640_OpCallback cb, void* ctx) {
+  if (count > AF_MAX_ZONES || (count && !zones)) return NULL;
+  if (!startOp(OV5640_OP_ZONE_CONFIG, cb, ctx)) return NULL;
+
+  zoneCount = count;
+  for (uint8_t i = 0; i < count; i++) {
+    zoneRect[i][0] = zoneCoord(zones[i].x, AF_ZONE_GRID_W);
+    zoneRect[i][1] = zoneCoord(zones[i].y, AF_ZONE_GRID_H);
+    zoneRect[i][2] = zoneCoord(zones[i].x + zones[i].w, AF_ZONE_GRID_W);
+    zoneRect[i][3] = zoneCoord(zones[i].y + zones[i].h, AF_ZONE_GRID_H);
+  }
+  return &op;
+}
+
+const OV5640_AsyncOp* OV5640::singleAutoFocusAsync(OV5640_OpCallback cb, void* ctx) {
+  return startOp(OV5640_OP_SINGLE_FOCUS, cb, ctx) ? &op : NULL;
+}
+
+/*
+ * Even phases issue a command, odd phases wait for its ACK.  op.offset
+ * walks the zone windows in custom mode.
+ *   touch:  0x81 (centre) -> zone-config state -> 0x12 launch
+ *   custom: 0x8F -> 0x90+n per zone -> zone-config state -> 0x12 launch
+ *   none:   0x80 (default zones) -> 0x12 launch
+ */
+void OV5640::stepZoneConfig() {
+  enum { CONFIG, CONFIG_ACK, ZONE, ZONE_ACK, STATE, LAUNCH, LAUNCH_ACK };
+
+  switch (op.phase) {
+    case CONFIG:
+      if (zoneCount == 0) {
+        if (!issue(AF_DEFAULT_ZONES)) return;
+      } else if (zoneCount == 1) {
+        afParam(OV5640_CMD_PARA0, (zoneRect[0][0] + zoneRect[0][2]) / 2);
+        afParam(OV5640_CMD_PARA1, (zoneRect[0][1] + zoneRect[0][3]) / 2);
+        if (!issue(AF_SET_TOUCH_ZONE)) return;
+      } else if (!issue(AF_CUSTOM_ZONES)) {
+        return;
+      }
+      op.phase = CONFIG_ACK;
+      break;
+
+    case CONFIG_ACK:
+      if (waitReg(OV5640_CMD_ACK, 0x00, OV5640_ERR_TIMEOUT))
+        op.phase = zoneCount == 0 ? LAUNCH : zoneCount == 1 ? STATE : ZONE;
+      break;
+
+    case ZONE:
+      for (uint8_t k = 0; k < 4; k++)
+        afParam(OV5640_CMD_PARA0 + k, zoneRect[op.offset][k]);
+      if (issue(AF_SET_ZONE_BASE + op.offset)) op.phase = ZONE_ACK;
+      break;
+
+    case ZONE_ACK:
+      if (waitReg(OV5640_CMD_ACK, 0x00, OV5640_ERR_TIMEOUT))
+        op.phase = ++op.offset < zoneCount ? ZONE : STATE;
+      break;
+
+    case STATE:
+      if (waitReg(OV5640_CMD_FW_STATUS, FW_STATUS_S_ZONE_CONFIG, OV5640_ERR_TIMEOUT)) op.phase = LAUNCH;
+      break;
+
+    case LAUNCH:
+      if (issue(AF_LAUNCH_ZONES)) op.phase = LAUNCH_ACK;
+      break;
+
+    default:
+      if (waitReg(OV5640_CMD_ACK, 0x00, OV5640_ERR_TIMEOUT)) finishOp(0);
+      break;
+  }
+}
+
+void OV5640::stepSingleFocus() {
+  switch (op.phase) {
+    case 0:
+      if (issue(AF_TRIG_SINGLE_AUTO_FOCUS)) op.phase++;
+      break;
+
+    case 1:
+      if (waitReg(OV5640_CMD_ACK, 0x00, OV5640_ERR_TIMEOUT)) op.phase++;
+      break;
+
+    case 2:
+      if (waitReg(OV5640_CMD_FW_STATUS, FW_STATUS_S_FOCUSED, OV5640_ERR_TIMEOUT)) op.phase++;
+      break;
+
+    default:
+      /* PARA0..4 report which zones ended up in focus */
+      op.zones = 0;
+      for (uint8_t i = 0; i < AF_MAX_ZONES; i++)
+        if (afRead(OV5640_CMD_PARA0 + i) > 0) op.zones |= 1 << i;
+      finishOp(0);
+      break;
+  }
+}
+
+/********************  Register shadow  ********************/
+
+#define AF_REG_FIRST      OV5640_CMD_MAIN
+#define AF_REG_COUNT      8
+#define AF_BIT(reg)       (1 << ((reg) - AF_REG_FIRST))
+#define AF_VOLATILE       (AF_BIT(OV5640_CMD_MAIN) | AF_BIT(OV5640_CMD_ACK) | AF_BIT(OV5640_CMD_FW_STATUS))
+#define AF_PARAMS         (0xff & ~AF_VOLATILE)
+
+static inline bool afReg(uint16_t reg) {
+  return reg >= AF_REG_FIRST && reg < AF_REG_FIRST + AF_REG_COUNT;
+}
+
+void OV5640::setRegisterCache(bool enable) {
+  afFlush();
+  cacheOn = enable;
+  afInvalidate();
+}
+
+void OV5640::afInvalidate() {
+  afValid = 0;
+  afDirty = 0;
+}
+
+void OV5640::afParam(uint16_t reg, uint8_t val) {
+  if (!cacheOn || !afReg(reg) || (AF_BIT(reg) & AF_VOLATILE)) {
+    core.write(reg, val);
+    return;
+  }
+  uint8_t i = reg - AF_REG_FIRST;
+  if (afDirty & AF_BIT(reg)) cacheStats.writesCoalesced++;
+  afStage[i] = val;
+  afDirty |= AF_BIT(reg);
+}
+
+/* Write staged parameters that differ from the bus; adjacent ones go out
+ * as one sequential write when the transport supports it. */
+int OV5640::afFlush() {
+  uint8_t i = 0;
+  int rc = 0;
+
+  while (afDirty && i < AF_REG_COUNT) {
+    uint8_t bit = 1 << i;
+    if (!(afDirty & bit)) { i++; continue; }
+    if ((afValid & bit) && afBus[i] == afStage[i]) {
+      cacheStats.writesDropped++;
+      afDirty &= ~bit;
+      i++;
+      continue;
+    }
+    uint8_t j = i;
+    while (j + 1 < AF_REG_COUNT && (afDirty & (1 << (j + 1))) &&
+           !((afValid & (1 << (j + 1))) && afBus[j + 1] == afStage[j + 1]))
+      j++;
+    rc = core.writeSeq(AF_REG_FIRST + i, &afStage[i], j - i + 1);
+    for (uint8_t k = i; k <= j; k++) {
+      afBus[k] = afStage[k];
+      afDirty &= ~(1 << k);
+      if (rc < 0) afValid &= ~(1 << k);
+      else afValid |= 1 << k;
+    }
+    if (rc < 0) return rc;
+    i = j + 1;
+  }
   return rc;
 }
+
+/* Staged parameters, then the command through the core; false and the op
+ * finished on a bus error */
+bool OV5640::issue(uint8_t cmd) {
+  if (afFlush() < 0 || core.issue(cmd) < 0) {
+    afInvalidate();
+    finishOp(OV5640_ERR_BUS);
+    return false;
+  }
+  OV5640_NOTE(OV5640_EVT_COMMAND, cmd);
+  op.pollAt = clock->nowUs() + core.pollPolicy().ackUs;
+
+  /* Only a lens move is known to leave the parameters alone; anything
+   * else may report results through them or move the lens itself. */
+  if (cmd != AF_MOVE_LENS) afValid &= ~AF_PARAMS;
+  return true;
+}
+
+int OV5640::afRead(uint16_t reg) {
+  if (!cacheOn || !afReg(reg) || (AF_BIT(reg) & AF_VOLATILE))
+    return core.read(reg);
+
+  uint8_t i = reg - AF_REG_FIRST;
+  if (afDirty & AF_BIT(reg)) return afStage[i];
+  if (afValid & AF_BIT(reg)) {
+    cacheStats.readsServed++;
+    return afBus[i];
+  }
+  int v = core.read(reg);
+  if (v >= 0) {
+    afBus[i] = v;
+    afValid |= AF_BIT(reg);
+  }
+  return v;
+}
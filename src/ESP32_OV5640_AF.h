@@ -7,34 +7,311 @@
 #ifndef ESP32_OV5640_AF_h
 #define ESP32_OV5640_AF_h
 
-#include <Arduino.h>
+#include "ESP32_OV5640_port.h"
 #include "ESP32_OV5640_cfg.h"
-#include "esp_camera.h"
+#include "ESP32_OV5640_transport.h"
+
+#define OV5640_HIST_BUCKETS               32
+#define OV5640_HIST_MIN_US                128
+
+#include "ESP32_OV5640_core.h"
+#include "ESP32_OV5640_telemetry.h"
+
+class OV5640;
+class OV5640_FocusCal;
+
+/**
+ * Completion latency histogram with half-log2 buckets: bucket 0 is below
+ * OV5640_HIST_MIN_US, the bounds then grow by sqrt(2) per bucket (128,
+ * 181, 256, 362 us ... about 4.2 s), the last bucket is open ended.
+ * Failed operations only count as timeouts.
+ */
+struct OV5640_LatencyHist {
+  uint32_t count[OV5640_HIST_BUCKETS];
+  uint32_t samples;
+  uint32_t timeouts;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint64_t sumUs;
+
+  void clear();
+  void add(uint32_t us);
+  /** Upper bound of bucket i in microseconds (0 for the open last bucket) */
+  static uint32_t bucketLimitUs(uint8_t i);
+  /** Upper bucket bound below which pct percent of the samples fall */
+  uint32_t percentileUs(uint8_t pct) const;
+  uint32_t meanUs() const { return samples ? (uint32_t)(sumUs / samples) : 0; }
+};
+
+enum OV5640_OpType {
+  OV5640_OP_NONE,
+  OV5640_OP_FOCUS_INIT,
+  OV5640_OP_AUTO_FOCUS,
+  OV5640_OP_MANUAL_FOCUS,
+  OV5640_OP_ZONE_CONFIG,
+  OV5640_OP_SINGLE_FOCUS,
+  OV5640_OP_SEQUENCE,
+  OV5640_OP_COUNT
+};
+
+/* Focus zone in normalized frame coordinates (0..1) */
+struct OV5640_FocusZone {
+  float x, y, w, h;
+};
+
+enum OV5640_OpState {
+  OV5640_OP_IDLE,
+  OV5640_OP_RUNNING,
+  OV5640_OP_DONE
+};
+
+/* Savings from the AF register shadow */
+struct OV5640_CacheStats {
+  uint32_t writesDropped;     // parameter writes equal to the bus value
+  uint32_t writesCoalesced;   // staged parameter overwritten before flush
+  uint32_t readsServed;       // parameter reads answered from the shadow
+};
+
+struct OV5640_AsyncOp;
+typedef void (*OV5640_OpCallback)(OV5640* cam, const OV5640_AsyncOp* op, void* ctx);
+
+/**
+ * An AF command in flight.  Started by one of the *Async() calls and
+ * advanced by OV5640::poll(); result holds the same code the blocking
+ * call would have returned once state is OV5640_OP_DONE.
+ */
+struct OV5640_AsyncOp {
+  OV5640_OpType type;
+  OV5640_OpState state;
+  uint8_t result;
+  uint8_t phase;
+  OV5640_PollState waitState;   // the current ACK / status wait
+  uint16_t offset;        // firmware bytes uploaded
+  uint16_t step;          // manual focus target
+  uint8_t zones;          // single focus: bit n = zone n in focus
+  bool reused;            // focus init found the firmware resident, no upload
+  uint32_t startUs;
+  uint32_t doneUs;
+  uint32_t pollAt;        // next time poll() touches the bus
+  const OV5640_SeqOp* seq;   // register sequence being played
+  uint16_t seqLen;
+  uint16_t seqPos;
+  OV5640_OpCallback cb;
+  void* ctx;
+
+  bool running() const { return state == OV5640_OP_RUNNING; }
+  bool done() const { return state == OV5640_OP_DONE; }
+};
 
 class OV5640 {
 private:
-  sensor_t* sensor;
+  OV5640_SCCBTransport sccb;
+  OV5640_Transport* bus;
+  OV5640_Core<OV5640_CameraBus> core;   // every register access, commands and waits
+  OV5640_Clock* clock;
+  uint16_t burstSize;
   bool isOV5640;
+  OV5640_AsyncOp op;
+  OV5640_LatencyHist hist[OV5640_OP_COUNT];
+  const OV5640_FocusCal* focusCal;
+
+  /* Write-through shadow of the AF block 0x3022..0x3029.  CMD_MAIN,
+   * CMD_ACK and FW_STATUS are volatile (triggers / owned by the MCU) and
+   * always go to the bus; PARA0..4 are staged and flushed before the next
+   * command, skipping values the bus already holds. */
+  bool cacheOn;
+  uint8_t afBus[8];           // value last written to / read from the bus
+  uint8_t afStage[8];         // staged, not yet written
+  uint8_t afValid;            // bits: afBus[] known
+  uint8_t afDirty;            // bits: afStage[] pending
+  OV5640_CacheStats cacheStats;
+
+  uint8_t zoneRect[AF_MAX_ZONES][4];   // x0, y0, x1, y1 on the zone grid
+  uint8_t zoneCount;
+
+  void afParam(uint16_t reg, uint8_t val);
+  int afFlush();
+  int afRead(uint16_t reg);
+  void afInvalidate();
+
+  bool startOp(OV5640_OpType type, OV5640_OpCallback cb, void* ctx);
+  void finishOp(uint8_t rc);
+  bool waitReg(uint16_t reg, uint8_t value, uint8_t timeoutRc,
+               uint8_t mask = 0xff, uint32_t timeoutMs = 0);
+  bool stepSeq();
+  void stepFocusInit();
+  void stepAutoFocus();
+  void stepManualFocus();
+  void stepZoneConfig();
+  void stepSingleFocus();
+  bool issue(uint8_t cmd);
+  OV5640_SeqStats seqCounters;
+
+  OV5640_Telemetry* tel;
+  uint32_t telTxns;           // bus transactions when the op started
+  uint8_t telStatus;          // last FW_STATUS seen
+  void note(uint8_t type, uint16_t arg = 0, uint32_t value = 0);
+  void noteStatus(int status);
 
 public:
   OV5640();
+  ~OV5640();
   bool start(sensor_t* _sensor);
-  uint8_t focusInit();
+  /**
+   * Use a custom register transport instead of sensor_t, e.g. a raw I2C
+   * driver that can upload the AF firmware with sequential writes.
+   * Always false in a -DOV5640_SCCB_ONLY=1 build.
+   */
+  bool start(OV5640_Transport* transport);
+  /** Bytes per sequential write during focusInit(), 0 = transport maximum */
+  void setBurstSize(uint16_t bytes) { burstSize = bytes; }
+  OV5640_Transport* getTransport() { return bus; }
+  /** Time source for the wait loops (defaults to micros()/delay()) */
+  void setClock(OV5640_Clock* _clock) {
+    clock = _clock;
+    core.setClock(_clock);
+  }
+  OV5640_Clock* getClock() { return clock; }
+  /**
+   * Load the AF firmware.  If the sensor stayed powered across an ESP32
+   * reboot and the firmware is still running, the upload is skipped;
+   * forceReload always resets the MCU and writes the full image.
+   * @returns OV5640_OK, OV5640_ERR_TIMEOUT, OV5640_ERR_NOT_OV5640 or
+   * OV5640_ERR_BUS (the same codes for every AF call)
+   */
+  uint8_t focusInit(bool forceReload = false);
+  /**
+   * true if the AF MCU is out of reset, reports a running firmware state
+   * and a checksum over OV5640_FW_PROBES bytes of firmware RAM matches
+   * OV5640_AF_Config.
+   */
+  bool firmwareResident();
+  /** Continuous AF; @returns the focusInit() codes */
   uint8_t autoFocusMode();
+  /**
+  * FW_STATUS register, OV5640_FW_STATUS_UNKNOWN if it can't be read.
+  * Not recorded in the telemetry, which only the poll() path feeds.
+  */
   uint8_t getFWStatus();
  /********************  Manual-focus additions  ********************/
  /**
   * Drive the lens to a specific VCM step.
   * @param step 0 = ∞️  (far), 1023 = macro (near)
-  * @returns 0=OK, 1=timeout, 2=sensor not OV5640
+  * @returns OV5640_OK, OV5640_ERR_TIMEOUT, OV5640_ERR_NOT_OV5640 or OV5640_ERR_BUS
   */
  uint8_t manualFocus(uint16_t step);
 /**
- * Convenience wrapper – focus to an approximate object distance
- * (10 mm … ∞).  The mapping is a coarse linear LUT that is good
-* enough for most webcams; tweak if your lens is different.
+ * Convenience wrapper – focus to an object distance (0 = ∞).  Interpolates
+ * the focus calibration, by default a generic table that is good enough
+ * for most webcams; load a per-module table for anything better.
  */
  uint8_t manualFocusDistance(uint16_t distance_mm);
+ /** Calibration used by manualFocusDistance(); NULL restores the default.
+  *  The table is not copied and must outlive the OV5640 object. */
+ void setFocusCalibration(const OV5640_FocusCal* cal);
+ const OV5640_FocusCal* getFocusCalibration() const { return focusCal; }
+
+ /********************  Focus zones  ********************/
+ /**
+  * Tell the AF firmware where to focus.  One zone is sent as a touch
+  * point at its centre, up to AF_MAX_ZONES as custom zone windows; the
+  * firmware passes through its zone-config state and the zones are
+  * launched.  count 0 (zones may be NULL) selects the firmware's default
+  * zones (AF_DEFAULT_ZONES) and launches them.
+  * @returns OV5640_OK, OV5640_ERR_TIMEOUT, OV5640_ERR_BUS, or
+  * OV5640_ERR_NOT_OV5640 (also for a bad zone count)
+  */
+ uint8_t setFocusZones(const OV5640_FocusZone* zones, uint8_t count);
+ /** Single zone centred on a touch point (normalized) */
+ uint8_t setFocusPoint(float x, float y);
+ /**
+  * One-shot AF (AF_TRIG_SINGLE_AUTO_FOCUS) on the configured zones; waits
+  * for FW_STATUS_S_FOCUSED.
+  * @param zonesFocused optional: bit n set if zone n is in focus
+  * @returns OV5640_OK, OV5640_ERR_TIMEOUT, OV5640_ERR_NOT_OV5640 or OV5640_ERR_BUS
+  */
+ uint8_t singleAutoFocus(uint8_t* zonesFocused = NULL);
+ /** setFocusPoint() followed by singleAutoFocus() */
+ uint8_t focusAt(float x, float y, uint8_t* zonesFocused = NULL);
+
+ /********************  Register sequences  ********************/
+ /**
+  * Play a register sequence, e.g. OV5640_SEQ_AF_PAUSE or a sensor mode
+  * table, with overwritten writes dropped and adjacent registers merged.
+  * @returns OV5640_OK, OV5640_ERR_TIMEOUT (a wait timed out), OV5640_ERR_BUS,
+  * or OV5640_ERR_NOT_OV5640 (also for a bad opcode)
+  */
+ uint8_t playSequence(const OV5640_SeqOp* seq, size_t n);
+ template <size_t N>
+ uint8_t playSequence(const OV5640_SeqOp (&seq)[N]) { return playSequence(seq, N); }
+ const OV5640_SeqStats& sequenceStats() const { return seqCounters; }
+ void resetSequenceStats() { memset(&seqCounters, 0, sizeof(seqCounters)); }
+
+ /********************  Telemetry  ********************/
+ /**
+  * Record AF events into tel (NULL stops).  Only has an effect when the
+  * library is built with OV5640_TELEMETRY=1, see telemetryBuilt().
+  * tel is not copied and must outlive the OV5640 object.  Its ring has a
+  * single producer, so one telemetry object serves one camera.
+  * @returns false, and keeps the current one, if tel is attached to
+  * another camera
+  */
+ bool setTelemetry(OV5640_Telemetry* _tel);
+ OV5640_Telemetry* getTelemetry() { return tel; }
+ /** true if the library was compiled with the telemetry hooks */
+ static bool telemetryBuilt();
+
+ /********************  Non-blocking API  ********************/
+ /**
+  * Start an operation and return at once.  The sensor runs one AF command
+  * at a time, so these return NULL while another operation is running (or
+  * the sensor is not an OV5640).  Call poll() from the main loop or a task
+  * until the op is done; cb, if given, is called from poll() on completion.
+  */
+ const OV5640_AsyncOp* focusInitAsync(OV5640_OpCallback cb = NULL, void* ctx = NULL,
+                                      bool forceReload = false);
+ const OV5640_AsyncOp* autoFocusModeAsync(OV5640_OpCallback cb = NULL, void* ctx = NULL);
+ const OV5640_AsyncOp* manualFocusAsync(uint16_t step, OV5640_OpCallback cb = NULL, void* ctx = NULL);
+ /**
+  * Advance the running operation.  Does at most one unit of bus work per
+  * call (a firmware chunk, a command, one status read) and nothing before
+  * the next poll time is due.
+  * @returns true while an operation is still running
+  */
+ bool poll();
+ const OV5640_AsyncOp* setFocusZonesAsync(const OV5640_FocusZone* zones, uint8_t count,
+                                          OV5640_OpCallback cb = NULL, void* ctx = NULL);
+ const OV5640_AsyncOp* singleAutoFocusAsync(OV5640_OpCallback cb = NULL, void* ctx = NULL);
+ /**
+  * Play a register sequence (see ESP32_OV5640_seq.h): one poll sends the
+  * writes up to the next wait or delay, waits follow the poll policy.
+  * seq must stay valid until the op is done.
+  */
+ const OV5640_AsyncOp* playSequenceAsync(const OV5640_SeqOp* seq, size_t n,
+                                         OV5640_OpCallback cb = NULL, void* ctx = NULL);
+ bool busy() const { return op.state == OV5640_OP_RUNNING; }
+ const OV5640_AsyncOp* currentOp() const { return &op; }
+ /** Poll until the running operation is done; @returns its result */
+ uint8_t wait();
+
+ /********************  Polling and latency  ********************/
+ /** Tight spin, then exponential backoff up to a cap */
+ static OV5640_PollPolicy defaultPollPolicy() { return OV5640_PollPolicy::defaults(); }
+ void setPollPolicy(const OV5640_PollPolicy& policy) { core.setPollPolicy(policy); }
+ const OV5640_PollPolicy& getPollPolicy() const { return core.pollPolicy(); }
+ /** Completion latency of firmware load, continuous-AF enable, manual move */
+ const OV5640_LatencyHist& latency(OV5640_OpType type) const { return hist[type]; }
+ void clearLatency();
+
+ /********************  Register shadow  ********************/
+ /** On by default; off sends every AF register access to the bus */
+ void setRegisterCache(bool enable);
+ /** Read an AF parameter register (PARA0..4), from the shadow if known */
+ int readParam(uint16_t reg) { return afRead(reg); }
+ const OV5640_CacheStats& getCacheStats() const { return cacheStats; }
+ void resetCacheStats() { memset(&cacheStats, 0, sizeof(cacheStats)); }
+ /** Bus transactions, reads and writes so far (from the transport) */
+ const OV5640_BusStats& busStats() const { return bus->stats(); }
 };
 
 #endif
@@ -0,0 +1,138 @@
+/*
+  ESP32_OV5640_bracket.cpp - Focus bracketing and focus stacking
+  Released into the public domain.
+*/
+
+#include "ESP32_OV5640_bracket.h"
+
+OV5640_Bracket::OV5640_Bracket(OV5640& _cam, OV5640_FrameSource& _source)
+  : cam(_cam), source(_source) {
+  cfg = defaultConfig();
+  n = 0;
+  elapsedUs = 0;
+  framesGrabbed = 0;
+  framesDropped = 0;
+  pendingStep = NULL;
+  moveIssued = false;
+}
+
+OV5640_BracketConfig OV5640_Bracket::defaultConfig() {
+  OV5640_BracketConfig c;
+  c.pipeline = true;
+  c.settleFrames = 0;
+  c.metric = OV5640_SHARP_TENENGRAD;
+  return c;
+}
+
+void OV5640_Bracket::release() {
+  for (uint8_t i = 0; i < n; i++) source.release(shots[i].frame);
+  n = 0;
+}
+
+/* Exposure of the kept frame is over: put the next move on the bus now */
+void OV5640_Bracket::onExposed(void* ctx) {
+  OV5640_Bracket* b = (OV5640_Bracket*)ctx;
+  if (!b->pendingStep || b->moveIssued) return;
+  b->moveIssued = b->cam.manualFocusAsync(*b->pendingStep) != NULL;
+  if (b->moveIssued) b->cam.poll();
+}
+
+/* Drop frames the source queued before the move and the settle frames,
+ * then grab the frame to keep */
+uint8_t OV5640_Bracket::grabKeeper(OV5640_Frame& frame) {
+  uint16_t drop = (uint16_t)source.staleFrames(n) + cfg.settleFrames;
+  for (uint16_t s = 0; s < drop; s++) {
+    if (!source.grab(frame)) return OV5640_BRACKET_NO_FRAME;
+    source.release(frame);
+    framesGrabbed++;
+    framesDropped++;
+  }
+
+  if (cfg.pipeline) source.onExposed(onExposed, this);
+  bool ok = source.grab(frame);
+  source.onExposed(NULL, NULL);
+  if (!ok) return OV5640_BRACKET_NO_FRAME;
+  framesGrabbed++;
+  return 0;
+}
+
+uint8_t OV5640_Bracket::capture(const uint16_t* steps, uint8_t count) {
+  release();
+  elapsedUs = 0;
+  framesGrabbed = 0;
+  framesDropped = 0;
+  if (count > OV5640_BRACKET_MAX) return OV5640_BRACKET_TOO_MANY;
+  if (!count) return 0;
+
+  OV5640_Clock* clock = cam.getClock();
+  uint32_t t0 = clock->nowUs();
+  uint8_t rc = cam.manualFocus(steps[0]);
+
+  for (uint8_t i = 0; rc == 0 && i < count; i++) {
+    bool last = i + 1 == count;
+    pendingStep = last ? NULL : &steps[i + 1];
+    moveIssued = false;
+
+    OV5640_Frame frame;
+    rc = grabKeeper(frame);
+    if (rc == 0) {
+      shots[n].frame = frame;
+      shots[n].step = steps[i];
+      n++;
+    }
+
+    /* a move started during readout still has to finish before the next
+     * exposure; without a readout hook it starts only now */
+    if (moveIssued) {
+      uint8_t moveRc = cam.wait();
+      if (rc == 0) rc = moveRc;
+    } else if (rc == 0 && !last) {
+      rc = cam.manualFocus(steps[i + 1]);
+    }
+  }
+
+  pendingStep = NULL;
+  elapsedUs = clock->nowUs() - t0;
+  return rc;
+}
+
+bool OV5640_Bracket::merge(uint8_t* out, uint16_t tile, uint8_t* map) const {
+  if (!n || !out) return false;
+  const OV5640_Frame& f0 = shots[0].frame;
+  for (uint8_t k = 1; k < n; k++)
+    if (shots[k].frame.width != f0.width || shots[k].frame.height != f0.height) return false;
+
+  uint16_t w = f0.width, h = f0.height;
+  if (!tile) tile = 1;
+  uint16_t tilesX = (w + tile - 1) / tile;
+
+  for (uint16_t y0 = 0, ty = 0; y0 < h; y0 += tile, ty++) {
+    uint16_t y1 = y0 + tile < h ? y0 + tile : h;
+    for (uint16_t x0 = 0, tx = 0; x0 < w; x0 += tile, tx++) {
+      uint16_t x1 = x0 + tile < w ? x0 + tile : w;
+
+      OV5640_Rect r = OV5640_Sharpness::tile(f0, tile, tx, ty);
+      uint8_t best = 0;
+      if (r.w) {
+        uint32_t bestScore = 0;
+        for (uint8_t k = 0; k < n; k++) {
+          uint32_t s = OV5640_Sharpness::score(cfg.metric, shots[k].frame, r);
+          if (s > bestScore) {
+            bestScore = s;
+            best = k;
+          }
+        }
+      }
+
+      const OV5640_Frame& f = shots[best].frame;
+      uint8_t px = f.format == OV5640_FRAME_YUV422 ? 2 : 1;
+      for (uint16_t y = y0; y < y1; y++) {
+        const uint8_t* src = f.data + (size_t)y * f.stride;
+        uint8_t* dst = out + (size_t)y * w;
+        for (uint16_t x = x0; x < x1; x++) dst[x] = src[x * px];
+      }
+      if (map) map[ty * tilesX + tx] = best;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,85 @@
+/*
+  ESP32_OV5640_bracket.h - Focus bracketing and focus stacking
+  Released into the public domain.
+
+  Captures one frame per lens step.  With pipelining on, the move to the
+  next step is issued as soon as the source reports the current frame
+  exposed, so with a source that knows when exposure ends lens travel
+  hides behind readout.  After every move the frames the source still
+  queues from before it (staleFrames()) are dropped.  Frames are kept by
+  reference: the source must be able to hand out `count` frames at once
+  (fb_count above the bracket size for esp32-camera).
+*/
+
+#ifndef ESP32_OV5640_bracket_h
+#define ESP32_OV5640_bracket_h
+
+#include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_sharpness.h"
+
+#define OV5640_BRACKET_MAX                16
+#define OV5640_BRACKET_NO_FRAME           (OV5640_RC_BRACKET + 0)
+#define OV5640_BRACKET_TOO_MANY           (OV5640_RC_BRACKET + 1)
+
+struct OV5640_BracketConfig {
+  bool pipeline;          // move during readout of the previous frame
+  uint8_t settleFrames;   // extra frames dropped after each move completes
+  OV5640_SharpMetric metric;   // used by merge()
+};
+
+struct OV5640_BracketShot {
+  OV5640_Frame frame;
+  uint16_t step;          // lens step the frame was taken at
+};
+
+class OV5640_Bracket {
+public:
+  OV5640_Bracket(OV5640& _cam, OV5640_FrameSource& _source);
+  ~OV5640_Bracket() { release(); }
+
+  /** Pipelined, no settle frames, Tenengrad for merging */
+  static OV5640_BracketConfig defaultConfig();
+  void configure(const OV5640_BracketConfig& _cfg) { cfg = _cfg; }
+  const OV5640_BracketConfig& config() const { return cfg; }
+
+  /**
+   * Take one frame at each step, in order.  Frames from a previous
+   * capture are released first.
+   * @returns OV5640_OK, a manualFocus() error, OV5640_BRACKET_NO_FRAME or
+   *          OV5640_BRACKET_TOO_MANY; frames taken so far are kept
+   */
+  uint8_t capture(const uint16_t* steps, uint8_t count);
+  /** Give every held frame back to the source */
+  void release();
+
+  uint8_t count() const { return n; }
+  const OV5640_BracketShot& shot(uint8_t i) const { return shots[i]; }
+
+  /**
+   * All-in-focus merge: every tile x tile block of out (8-bit luma, width
+   * * height) is copied from the shot that is sharpest there.  map, if
+   * given, receives the winning shot index per tile, row-major.
+   * @returns false without shots or if the shots differ in size
+   */
+  bool merge(uint8_t* out, uint16_t tile, uint8_t* map = NULL) const;
+
+  /* Statistics of the last capture */
+  uint32_t elapsedUs;
+  uint16_t framesGrabbed;
+  uint16_t framesDropped;
+
+private:
+  static void onExposed(void* ctx);
+  uint8_t grabKeeper(OV5640_Frame& frame);
+
+  OV5640& cam;
+  OV5640_FrameSource& source;
+  OV5640_BracketConfig cfg;
+  OV5640_BracketShot shots[OV5640_BRACKET_MAX];
+  uint8_t n;
+
+  const uint16_t* pendingStep;   // move to issue once exposed, NULL = none
+  bool moveIssued;
+};
+
+#endif
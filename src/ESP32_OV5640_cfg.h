@@ -4,9 +4,15 @@
   Released into the public domain.
 */
 
+#ifndef ESP32_OV5640_cfg_h
+#define ESP32_OV5640_cfg_h
+
 #define OV5640_CHIPID_HIGH                0x300a
 #define OV5640_CHIPID_LOW                 0x300b
 
+#define OV5640_MCU_RESET                  0x3000
+#define OV5640_FW_BASE                    0x8000
+
 #define OV5640_CMD_MAIN                   0x3022
 #define OV5640_CMD_ACK                    0x3023
 #define OV5640_CMD_PARA0                  0x3024
@@ -19,6 +25,17 @@
 #define AF_TRIG_SINGLE_AUTO_FOCUS           0x03
 #define AF_CONTINUE_AUTO_FOCUS              0x04
 #define AF_MOVE_LENS                        0x05 
+#define AF_PAUSE_AUTO_FOCUS                 0x06
+#define AF_RELEASE_FOCUS                    0x08
+#define AF_LAUNCH_ZONES                     0x12 //apply the zone configuration
+#define AF_DEFAULT_ZONES                    0x80 //back to the firmware's default zones
+#define AF_SET_TOUCH_ZONE                   0x81 //PARA0/1 = zone centre x/y
+#define AF_CUSTOM_ZONES                     0x8F //enter custom zone configuration
+#define AF_SET_ZONE_BASE                    0x90 //0x90 + n: PARA0..3 = x0, y0, x1, y1
+
+#define AF_ZONE_GRID_W                      80   //zone coordinates grid
+#define AF_ZONE_GRID_H                      60
+#define AF_MAX_ZONES                        5
 
 #define FW_STATUS_S_FIRMWARE                0x7F
 #define FW_STATUS_S_STARTUP                 0x7E
@@ -32,7 +49,9 @@ struct sensor_reg {
 	uint8_t val;
 };
 
-const unsigned char OV5640_AF_Config[] =
+/* constexpr: the image and everything derived from it (size, probe
+ * checksum, chunk counts) are compile-time constants in flash */
+constexpr unsigned char OV5640_AF_Config[] =
 {
 	0x02, 0x0f, 0xd6, 0x02, 0x0a, 0x39, 0xc2, 0x01, 0x22, 0x22, 0x00, 0x02, 0x0f, 0xb2, 0xe5, 0x1f, //0x8000,
 	0x70, 0x72, 0xf5, 0x1e, 0xd2, 0x35, 0xff, 0xef, 0x25, 0xe0, 0x24, 0x4e, 0xf8, 0xe4, 0xf6, 0x08, //0x8010,
@@ -289,4 +308,6 @@ const unsigned char OV5640_AF_Config[] =
 	0xf0, 0xd0, 0x82, 0xd0, 0x83, 0xd0, 0xe0, 0x32, 0x90, 0x0e, 0x5f, 0xe4, 0x93, 0xfe, 0x74, 0x01, //0x8fc0,
 	0x93, 0xf5, 0x82, 0x8e, 0x83, 0x22, 0x78, 0x7f, 0xe4, 0xf6, 0xd8, 0xfd, 0x75, 0x81, 0xcd, 0x02, //0x8fd0,
 	0x0c, 0x98, 0x8f, 0x82, 0x8e, 0x83, 0x75, 0xf0, 0x04, 0xed, 0x02, 0x06, 0xa5,                   //0x8fe0
-}; 
+};
+
+#endif
@@ -0,0 +1,56 @@
+/*
+  ESP32_OV5640_check.h - Pass/fail checks for the benchmark sketches
+  Released into the public domain.
+
+  The benchmarks double as host tests.  Each one states what it measured
+  with a check, prints a summary at the end and, on a host, returns
+  exitCode() from main(), so a failed check fails the run:
+
+    OV5640_Check check;
+    check(txns <= 98, "burst upload: %lu transactions", (unsigned long)txns);
+    ...
+    check.summary();
+    int main() { setup(); return check.exitCode(); }
+*/
+
+#ifndef ESP32_OV5640_check_h
+#define ESP32_OV5640_check_h
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+class OV5640_Check {
+public:
+  OV5640_Check() : checks(0), failures(0) {}
+
+  /** Count a check; print FAIL and the printf-style message when ok is false */
+  bool operator()(bool ok, const char* fmt, ...) {
+    checks++;
+    if (ok) return true;
+    failures++;
+    va_list ap;
+    va_start(ap, fmt);
+    printf("FAIL: ");
+    vprintf(fmt, ap);
+    printf("\n");
+    va_end(ap);
+    return false;
+  }
+
+  void summary() const {
+    if (failures)
+      printf("\nFAILED %lu of %lu checks\n", (unsigned long)failures, (unsigned long)checks);
+    else
+      printf("\nall %lu checks passed\n", (unsigned long)checks);
+  }
+
+  uint32_t failed() const { return failures; }
+  int exitCode() const { return failures ? 1 : 0; }
+
+private:
+  uint32_t checks;
+  uint32_t failures;
+};
+
+#endif
@@ -0,0 +1,566 @@
+/*
+  ESP32_OV5640_core.h - Statically dispatched register core for the OV5640 AF MCU
+  Released into the public domain.
+
+  OV5640_Core<Bus> is the register-level AF logic - chip probe, firmware
+  upload, warm-start check, release sequence, commands and status waits -
+  written against a bus policy instead of the virtual OV5640_Transport.
+  Every register access is a direct call the compiler can inline.  A bus
+  policy is any class with:
+
+    int read(uint16_t reg);                                 // 0..255, <0 on error
+    int write(uint16_t reg, uint8_t val);                   // 0, <0 on error
+    int writeBurst(uint16_t reg, const uint8_t* data, size_t len);
+    size_t maxBurst() const;                                // 0 = single bytes only
+
+  OV5640 keeps its runtime-selectable transport and runs its async steps
+  on the same core through OV5640_CameraBus (the built-in SCCB transport
+  bound at compile time, any other through its virtual interface); code
+  that knows its bus at compile time can use OV5640_Core<OV5640_SCCBBus>,
+  <OV5640_WireBus> or <OV5640_MockBus> directly.
+*/
+
+#ifndef ESP32_OV5640_core_h
+#define ESP32_OV5640_core_h
+
+#include "ESP32_OV5640_port.h"
+#include "ESP32_OV5640_cfg.h"
+#include "ESP32_OV5640_transport.h"
+#include "ESP32_OV5640_seq.h"
+
+/* 1: the OV5640 class only talks through esp32-camera's sensor_t */
+#ifndef OV5640_SCCB_ONLY
+#define OV5640_SCCB_ONLY                  0
+#endif
+
+#define OV5640_POLL_TIMEOUT_MS            5000
+#define OV5640_FW_PROBES                  16
+
+/* Result codes of the AF calls.  3..15 belong to the modules built on
+ * top, each in its own range below, so a code names its module. */
+#define OV5640_OK                         0
+#define OV5640_ERR_TIMEOUT                1      // ACK / status wait ran out
+#define OV5640_ERR_NOT_OV5640             2      // no OV5640, busy, or bad argument
+#define OV5640_ERR_BUS                    16     // register access failed
+
+#define OV5640_RC_SOFTAF                  3      // 3..4   OV5640_SOFTAF_*
+#define OV5640_RC_BRACKET                 5      // 5..6   OV5640_BRACKET_*
+#define OV5640_RC_CAL                     7      // 7      OV5640_CAL_*
+#define OV5640_RC_MULTI                   8      // 8..9   OV5640_MULTI_*
+                                                 // 10..15 free
+
+#define OV5640_FW_STATUS_UNKNOWN          0xFF   // getFWStatus() without an answer
+
+/**
+ * Compile-time facts about the AF firmware image: its size and the
+ * warm-start probe, OV5640_FW_PROBES bytes evenly spread over the image
+ * folded into a 16-bit rotate/xor checksum.
+ */
+struct OV5640_Firmware {
+  static constexpr uint16_t size() { return sizeof(OV5640_AF_Config); }
+
+  static constexpr uint16_t probeOffset(uint8_t i) {
+    return (uint16_t)((size() - 1) * i / (OV5640_FW_PROBES - 1));
+  }
+
+  static constexpr uint16_t fold(uint16_t acc, uint8_t b) {
+    return (uint16_t)(((acc << 1) | (acc >> 15)) ^ b);
+  }
+
+  static constexpr uint16_t checksum(uint8_t i = 0, uint16_t acc = 0) {
+    return i == OV5640_FW_PROBES ? acc
+         : checksum(i + 1, fold(acc, OV5640_AF_Config[probeOffset(i)]));
+  }
+
+  /** Transactions needed to upload the image in chunks of n bytes */
+  static constexpr uint16_t chunks(uint16_t n) { return (size() + n - 1) / n; }
+};
+
+/**
+ * How the ACK / firmware-status waits poll the bus: spinPolls reads
+ * spinUs apart, then an interval starting at initialUs that is multiplied
+ * by growth after every read up to maxUs.  The wait gives up after
+ * timeoutMs.  The ACK of a command is first read ackUs after the command:
+ * the MCU never clears it sooner.  {0, 0, 5000, 1, 5000, 5000} is the old
+ * fixed 5 ms loop.
+ */
+struct OV5640_PollPolicy {
+  uint8_t spinPolls;
+  uint16_t spinUs;
+  uint32_t initialUs;
+  uint8_t growth;
+  uint32_t maxUs;
+  uint32_t timeoutMs;
+  uint32_t ackUs;
+
+  /** ACK first read 2 ms after a command; 2 reads 2 ms apart, then 2 ms doubling up to 10 ms */
+  static OV5640_PollPolicy defaults() {
+    OV5640_PollPolicy p = { 2, 2000, 2000, 2, 10000, OV5640_POLL_TIMEOUT_MS, 2000 };
+    return p;
+  }
+};
+
+/* One status wait in progress, see OV5640_Core::pollReg(); zero it to start */
+struct OV5640_PollState {
+  uint16_t polls;         // reads that did not match yet
+  uint32_t interval;      // current backoff interval
+  uint32_t startUs;       // first read that did not match
+  uint32_t nextUs;        // when to read again
+  int value;              // last value read, <0 on bus error
+};
+
+/* Hold the MCU in reset before the upload */
+static constexpr sensor_reg OV5640_FW_HOLD[] = {
+  {OV5640_MCU_RESET,     0x20},
+};
+
+/********************  Bus policies  ********************/
+
+/* esp32-camera SCCB through sensor_t::set_reg/get_reg (single bytes only) */
+struct OV5640_SCCBBus {
+  sensor_t* sensor;
+
+  explicit OV5640_SCCBBus(sensor_t* _sensor = NULL) : sensor(_sensor) {}
+
+  int read(uint16_t reg) { return sensor->get_reg(sensor, reg, 0xff); }
+  int write(uint16_t reg, uint8_t val) { return sensor->set_reg(sensor, reg, 0xff, val); }
+  int writeBurst(uint16_t reg, const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      int rc = write(reg + i, data[i]);
+      if (rc < 0) return rc;
+    }
+    return 0;
+  }
+  size_t maxBurst() const { return 0; }
+};
+
+/* Any OV5640_Transport, chosen at run time; its bus statistics stay valid */
+struct OV5640_TransportBus {
+  OV5640_Transport* transport;
+
+  explicit OV5640_TransportBus(OV5640_Transport* _transport = NULL) : transport(_transport) {}
+
+  int read(uint16_t reg) { return transport->read(reg); }
+  int write(uint16_t reg, uint8_t val) { return transport->write(reg, val); }
+  int writeBurst(uint16_t reg, const uint8_t* data, size_t len) {
+    return transport->writeSeq(reg, data, len, len);
+  }
+  size_t maxBurst() const { return transport->maxBurst(); }
+};
+
+/**
+ * Register file in RAM for host tests and benchmarks.  Holds the chip ID,
+ * the 0x3000 page and the firmware area; the AF MCU answers instantly:
+ * a command clears ACK, releasing the MCU reports FW_STATUS idle.
+ */
+struct OV5640_MockBus {
+  uint8_t page[0x100];                  // 0x3000..0x30FF
+  uint8_t fw[OV5640_Firmware::size()];
+  uint32_t accesses;
+
+  OV5640_MockBus() {
+    memset(page, 0, sizeof(page));
+    memset(fw, 0, sizeof(fw));
+    page[OV5640_MCU_RESET & 0xff] = 0x20;
+    page[OV5640_CHIPID_HIGH & 0xff] = 0x56;
+    page[OV5640_CHIPID_LOW & 0xff] = 0x40;
+    accesses = 0;
+  }
+
+  /* firmware RAM index, or sizeof(fw) outside it */
+  size_t fwIndex(uint16_t reg) const {
+    size_t i = (size_t)reg - OV5640_FW_BASE;
+    return reg >= OV5640_FW_BASE && i < sizeof(fw) ? i : sizeof(fw);
+  }
+
+  int read(uint16_t reg) {
+    accesses++;
+    if ((reg & 0xff00) == 0x3000) return page[reg & 0xff];
+    size_t i = fwIndex(reg);
+    return i < sizeof(fw) ? fw[i] : 0;
+  }
+
+  int write(uint16_t reg, uint8_t val) {
+    accesses++;
+    if ((reg & 0xff00) == 0x3000) {
+      page[reg & 0xff] = val;
+      if (reg == OV5640_CMD_MAIN) page[OV5640_CMD_ACK & 0xff] = 0;
+      if (reg == OV5640_MCU_RESET && val == 0)
+        page[OV5640_CMD_FW_STATUS & 0xff] = FW_STATUS_S_IDLE;
+    } else if (fwIndex(reg) < sizeof(fw)) {
+      fw[fwIndex(reg)] = val;
+    }
+    return 0;
+  }
+
+  int writeBurst(uint16_t reg, const uint8_t* data, size_t len) {
+    accesses++;
+    size_t i = fwIndex(reg);
+    if (i < sizeof(fw) && i + len <= sizeof(fw)) {
+      memcpy(fw + i, data, len);
+      return 0;
+    }
+    for (size_t j = 0; j < len; j++) write(reg + j, data[j]);
+    accesses -= len;
+    return 0;
+  }
+
+  size_t maxBurst() const { return OV5640_BURST_DEFAULT; }
+};
+
+/**
+ * The bus of the OV5640 class: its own SCCB transport through the
+ * non-virtual accessors, so the default setup inlines down to the
+ * sensor_t call, and any other transport through its virtual interface.
+ * Both keep the transport's bus statistics.  Picking between the two costs
+ * one predictable branch per access; a build with -DOV5640_SCCB_ONLY=1
+ * drops the branch and the other transports, and OV5640::start() then
+ * refuses anything but sensor_t.
+ */
+struct OV5640_CameraBus {
+  OV5640_Transport* transport;
+  OV5640_SCCBTransport* sccb;   // transport, when it is the SCCB one
+
+  explicit OV5640_CameraBus(OV5640_Transport* _transport = NULL, OV5640_SCCBTransport* _sccb = NULL)
+    : transport(_transport), sccb(_sccb) {}
+
+#if OV5640_SCCB_ONLY
+  int read(uint16_t reg) { return sccb->readDirect(reg); }
+  int write(uint16_t reg, uint8_t val) { return sccb->writeDirect(reg, val); }
+  size_t maxBurst() const { return 0; }
+#else
+  int read(uint16_t reg) { return sccb ? sccb->readDirect(reg) : transport->read(reg); }
+  int write(uint16_t reg, uint8_t val) {
+    return sccb ? sccb->writeDirect(reg, val) : transport->write(reg, val);
+  }
+  size_t maxBurst() const { return sccb ? 0 : transport->maxBurst(); }
+#endif
+  int writeBurst(uint16_t reg, const uint8_t* data, size_t len) {
+    return transport->writeSeq(reg, data, len, len);
+  }
+};
+
+/********************  Core  ********************/
+
+template <class Bus>
+class OV5640_Core {
+public:
+  explicit OV5640_Core(const Bus& _bus = Bus(), OV5640_Clock* _clock = OV5640_Clock::system())
+    : io(_bus), clock(_clock), policy(OV5640_PollPolicy::defaults()) {}
+
+  Bus& bus() { return io; }
+  void setClock(OV5640_Clock* _clock) { clock = _clock; }
+  void setPollPolicy(const OV5640_PollPolicy& _policy) { policy = _policy; }
+  const OV5640_PollPolicy& pollPolicy() const { return policy; }
+
+  int read(uint16_t reg) { return io.read(reg); }
+  int write(uint16_t reg, uint8_t val) { return io.write(reg, val); }
+
+  /** Chip ID 0x5640? */
+  bool probe() {
+    return io.read(OV5640_CHIPID_HIGH) == 0x56 && io.read(OV5640_CHIPID_LOW) == 0x40;
+  }
+
+  /**
+   * Write len bytes from reg on: chunks of at most chunk bytes (0 = the
+   * bus maximum) when the bus has sequential writes, else byte by byte.
+   * @returns 0, <0 on bus error
+   */
+  int writeSeq(uint16_t reg, const uint8_t* data, size_t len, size_t chunk = 0) {
+    size_t burst = io.maxBurst();
+    int rc;
+
+    if (burst == 0 || chunk == 1) {
+      for (size_t i = 0; i < len; i++) {
+        rc = io.write(reg + i, data[i]);
+        if (rc < 0) return rc;
+      }
+      return 0;
+    }
+
+    if (chunk == 0 || chunk > burst) chunk = burst;
+    while (len) {
+      size_t n = len < chunk ? len : chunk;
+      rc = io.writeBurst(reg, data, n);
+      if (rc < 0) return rc;
+      reg += n;
+      data += n;
+      len -= n;
+    }
+    return 0;
+  }
+
+  /** Write a register table in order; @returns 0, <0 on the first bus error */
+  int writeTable(const sensor_reg* seq, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      int rc = io.write(seq[i].reg, seq[i].val);
+      if (rc < 0) return rc;
+    }
+    return 0;
+  }
+
+  template <size_t N>
+  int writeTable(const sensor_reg (&seq)[N]) { return writeTable(seq, N); }
+
+  /** Hold the AF MCU in reset */
+  int holdMCU() { return writeTable(OV5640_FW_HOLD); }
+  /** Upload len firmware bytes starting at offset */
+  int uploadFirmware(uint16_t offset, uint16_t len, size_t chunk = 0) {
+    return writeSeq(OV5640_FW_BASE + offset, OV5640_AF_Config + offset, len, chunk);
+  }
+
+  /**
+   * Is our firmware already running?  Out of reset, a firmware status that
+   * a running image reports, and the probe bytes match the image.
+   */
+  bool firmwareResident() {
+    int rst = io.read(OV5640_MCU_RESET);
+    if (rst < 0 || (rst & 0x20)) return false;      // MCU held in reset
+
+    int st = io.read(OV5640_CMD_FW_STATUS);
+    if (st < 0 || st == FW_STATUS_S_FIRMWARE || st == FW_STATUS_S_STARTUP) return false;
+    if (!(st == FW_STATUS_S_IDLE || st == FW_STATUS_S_FOCUSED ||
+          st == FW_STATUS_S_ZONE_CONFIG || st <= 0x0F || (st >= 0x80 && st <= 0x8F)))
+      return false;
+
+    uint16_t acc = 0;
+    for (uint8_t i = 0; i < OV5640_FW_PROBES; i++) {
+      int b = io.read(OV5640_FW_BASE + OV5640_Firmware::probeOffset(i));
+      if (b < 0) return false;
+      acc = OV5640_Firmware::fold(acc, b);
+    }
+    return acc == OV5640_Firmware::checksum();
+  }
+
+  /**
+   * One read of a status wait, for callers that run their own loop.
+   * @returns true once the wait is over, with rc OV5640_OK when
+   * (reg & mask) == value, timeoutRc after timeoutMs (0 = the policy's)
+   * or OV5640_ERR_BUS; false while it goes on, with w.nextUs the time of
+   * the next read per the poll policy
+   */
+  bool pollReg(OV5640_PollState& w, uint16_t reg, uint8_t value, uint8_t timeoutRc, uint8_t& rc,
+               uint8_t mask = 0xff, uint32_t timeoutMs = 0) {
+    w.value = io.read(reg);
+    if (w.value < 0) {
+      rc = OV5640_ERR_BUS;
+      return true;
+    }
+    if ((w.value & mask) == value) {      // common case: no clock read at all
+      rc = OV5640_OK;
+      return true;
+    }
+
+    uint32_t now = clock->nowUs();
+    if (w.polls++ == 0) {
+      w.startUs = now;
+      w.interval = 0;
+    }
+    if (!timeoutMs) timeoutMs = policy.timeoutMs;
+    if (now - w.startUs >= timeoutMs * 1000UL) {
+      rc = timeoutRc;
+      return true;
+    }
+
+    uint32_t dt;
+    if (w.polls <= policy.spinPolls) {
+      dt = policy.spinUs;
+    } else {
+      dt = w.interval ? w.interval * policy.growth : policy.initialUs;
+      if (dt > policy.maxUs) dt = policy.maxUs;
+      w.interval = dt;
+    }
+    w.nextUs = now + dt;
+    return false;
+  }
+
+  /**
+   * Read reg until (reg & mask) equals value, sleeping per the poll policy.
+   * @returns 0 when it does, timeoutRc after timeoutMs (0 = the policy's),
+   * OV5640_ERR_BUS
+   */
+  uint8_t waitFor(uint16_t reg, uint8_t value, uint8_t timeoutRc,
+                  uint32_t timeoutMs = 0, uint8_t mask = 0xff) {
+    OV5640_PollState w;
+    memset(&w, 0, sizeof(w));
+    uint8_t rc;
+    while (!pollReg(w, reg, value, timeoutRc, rc, mask, timeoutMs)) {
+      int32_t dt = (int32_t)(w.nextUs - clock->nowUs());
+      if (dt > 0) clock->sleepUs(dt);
+    }
+    return rc;
+  }
+
+  /** Set ACK and issue cmd; ACK clearing means done.  @returns 0, <0 on bus error */
+  int issue(uint8_t cmd) {
+    int rc = io.write(OV5640_CMD_ACK, 0x01);
+    return rc < 0 ? rc : io.write(OV5640_CMD_MAIN, cmd);
+  }
+
+  /** issue() and wait for the MCU to clear ACK */
+  uint8_t command(uint8_t cmd, uint8_t timeoutRc) {
+    if (issue(cmd) < 0) return OV5640_ERR_BUS;
+    if (policy.ackUs) clock->sleepUs(policy.ackUs);
+    return waitFor(OV5640_CMD_ACK, 0x00, timeoutRc);
+  }
+
+  /********  Sequence player  ********/
+
+  /**
+   * Play the writes from seq[pos] up to the next wait, delay or end, in
+   * table order, with overwritten writes dropped and consecutive runs of
+   * adjacent registers merged (sorted first after unordered()); pos is
+   * left on the op that stopped it.
+   * @returns 0, <0 on bus error
+   */
+  int playWrites(const OV5640_SeqOp* seq, size_t n, size_t& pos, OV5640_SeqStats* stats = NULL) {
+    OV5640_SeqStats none;
+    memset(&none, 0, sizeof(none));
+    if (!stats) stats = &none;
+    uint16_t regs[OV5640_SEQ_MAX_PENDING];
+    uint8_t vals[OV5640_SEQ_MAX_PENDING];
+    size_t count = 0;
+    bool sorted = false;
+    int rc;
+
+    for (; pos < n; pos++) {
+      const OV5640_SeqOp& s = seq[pos];
+      if (s.op == OV5640_SEQ_UNORDERED) {
+        if ((rc = flushWrites(regs, vals, count, false, stats)) < 0) return rc;
+        count = 0;
+        sorted = true;
+        continue;
+      }
+      if (s.op != OV5640_SEQ_WRITE && s.op != OV5640_SEQ_MASK) break;
+      stats->ops++;
+
+      size_t i = 0;
+      while (i < count && regs[i] != s.reg) i++;
+      uint8_t val = s.val;
+      if (s.op == OV5640_SEQ_MASK) {
+        int base = i < count ? vals[i] : io.read(s.reg);
+        if (i == count) stats->reads++;
+        if (base < 0) return base;
+        val = (base & ~s.mask) | (s.val & s.mask);
+      }
+
+      if (OV5640_Seq::isTrigger(s.reg)) {
+        if ((rc = flushWrites(regs, vals, count, sorted, stats)) < 0) return rc;
+        count = 0;
+        sorted = false;                 // a trigger is a barrier too
+        stats->writes++;
+        stats->transactions++;
+        if ((rc = io.write(s.reg, val)) < 0) return rc;
+      } else if (i < count && sorted) {
+        vals[i] = val;
+        stats->dropped++;
+      } else {
+        if (i < count) {
+          /* the earlier write goes; this one keeps its place in the table */
+          for (; i + 1 < count; i++) {
+            regs[i] = regs[i + 1];
+            vals[i] = vals[i + 1];
+          }
+          count--;
+          stats->dropped++;
+        }
+        if (count == OV5640_SEQ_MAX_PENDING) {
+          if ((rc = flushWrites(regs, vals, count, sorted, stats)) < 0) return rc;
+          count = 0;
+        }
+        regs[count] = s.reg;
+        vals[count++] = val;
+      }
+    }
+    return flushWrites(regs, vals, count, sorted, stats);
+  }
+
+  /**
+   * Play a whole sequence, blocking through waits and delays.
+   * @returns OV5640_OK, OV5640_ERR_TIMEOUT if a wait timed out,
+   * OV5640_ERR_BUS, or OV5640_ERR_NOT_OV5640 for a bad opcode
+   */
+  uint8_t play(const OV5640_SeqOp* seq, size_t n, OV5640_SeqStats* stats = NULL) {
+    size_t pos = 0;
+    while (pos < n) {
+      if (playWrites(seq, n, pos, stats) < 0) return OV5640_ERR_BUS;
+      if (pos >= n) break;
+
+      const OV5640_SeqOp& s = seq[pos++];
+      if (s.op == OV5640_SEQ_END) break;
+      if (s.op == OV5640_SEQ_DELAY) {
+        if (s.ms) clock->sleepMs(s.ms);
+      } else if (s.op == OV5640_SEQ_WAIT) {
+        uint8_t rc = waitFor(s.reg, s.val, OV5640_ERR_TIMEOUT, s.ms, s.mask);
+        if (rc) return rc;
+      } else {
+        return OV5640_ERR_NOT_OV5640;   // not an opcode
+      }
+    }
+    return 0;
+  }
+
+  template <size_t N>
+  uint8_t play(const OV5640_SeqOp (&seq)[N], OV5640_SeqStats* stats = NULL) {
+    return play(seq, N, stats);
+  }
+
+  /********  Blocking AF operations, same result codes as OV5640  ********/
+
+  uint8_t focusInit(bool forceReload = false, size_t chunk = OV5640_BURST_DEFAULT) {
+    if (!forceReload && firmwareResident()) return 0;
+    if (holdMCU() < 0) return OV5640_ERR_BUS;
+    if (uploadFirmware(0, OV5640_Firmware::size(), chunk) < 0) return OV5640_ERR_BUS;
+    return play(OV5640_SEQ_FW_RELEASE);
+  }
+
+  uint8_t autoFocusMode() { return play(OV5640_SEQ_AF_CONTINUOUS); }
+
+  uint8_t manualFocus(uint16_t step) {
+    step &= 0x03FF;
+    if (io.write(OV5640_CMD_PARA3, step >> 8) < 0 || io.write(OV5640_CMD_PARA4, step & 0xFF) < 0)
+      return OV5640_ERR_BUS;
+    return command(AF_MOVE_LENS, OV5640_ERR_TIMEOUT);
+  }
+
+  uint8_t getFWStatus() {
+    int v = io.read(OV5640_CMD_FW_STATUS);
+    return v < 0 ? OV5640_FW_STATUS_UNKNOWN : v;
+  }
+
+private:
+  /* Send the pending writes, runs of adjacent registers as sequential
+   * writes; sorted by address first in an unordered() section */
+  int flushWrites(uint16_t* regs, uint8_t* vals, size_t count, bool sorted,
+                  OV5640_SeqStats* stats) {
+    for (size_t i = 1; sorted && i < count; i++) {
+      uint16_t r = regs[i];
+      uint8_t v = vals[i];
+      size_t j = i;
+      for (; j > 0 && regs[j - 1] > r; j--) {
+        regs[j] = regs[j - 1];
+        vals[j] = vals[j - 1];
+      }
+      regs[j] = r;
+      vals[j] = v;
+    }
+
+    size_t burst = io.maxBurst();
+    for (size_t i = 0; i < count;) {
+      size_t run = 1;
+      while (i + run < count && run < burst && regs[i + run] == regs[i] + run) run++;
+      int rc = run > 1 ? io.writeBurst(regs[i], vals + i, run) : io.write(regs[i], vals[i]);
+      if (rc < 0) return rc;
+      stats->writes += run;
+      stats->transactions++;
+      i += run;
+    }
+    return 0;
+  }
+
+  Bus io;
+  OV5640_Clock* clock;
+  OV5640_PollPolicy policy;
+};
+
+#endif
@@ -0,0 +1,78 @@
+/*
+  ESP32_OV5640_depth.cpp - Depth from focus over lens sweeps
+  Released into the public domain.
+*/
+
+#include "ESP32_OV5640_depth.h"
+
+OV5640_DepthMap::OV5640_DepthMap() {
+  best = NULL;
+  bestStep = NULL;
+  width = height = tile = 0;
+  tx = ty = 0;
+  nFrames = 0;
+  minScore = 0;
+  metric = OV5640_SHARP_TENENGRAD;
+}
+
+bool OV5640_DepthMap::begin(uint32_t* arena, size_t size, uint16_t _width, uint16_t _height,
+                            uint16_t _tile, OV5640_SharpMetric _metric) {
+  size_t need = arenaSize(_width, _height, _tile);
+  if (!arena || !need || size < need) return false;
+
+  width = _width;
+  height = _height;
+  tile = _tile;
+  metric = _metric;
+  tx = (width + tile - 1) / tile;
+  ty = (height + tile - 1) / tile;
+
+  /* scores first, so the steps after them are aligned as well */
+  best = arena;
+  bestStep = (uint16_t*)(best + (size_t)tx * ty);
+  reset();
+  return true;
+}
+
+void OV5640_DepthMap::reset() {
+  size_t n = (size_t)tx * ty;
+  for (size_t i = 0; i < n; i++) {
+    best[i] = 0;
+    bestStep[i] = OV5640_DEPTH_UNKNOWN;
+  }
+  nFrames = 0;
+}
+
+bool OV5640_DepthMap::add(const OV5640_Frame& frame, uint16_t step) {
+  if (!best || frame.width != width || frame.height != height) return false;
+
+  uint32_t* s = best;
+  uint16_t* st = bestStep;
+  for (uint16_t y = 0; y < ty; y++) {
+    for (uint16_t x = 0; x < tx; x++, s++, st++) {
+      OV5640_Rect r = OV5640_Sharpness::tile(frame, tile, x, y);
+      uint32_t v = OV5640_Sharpness::score(metric, frame, r);
+      if (v > *s) {
+        *s = v;
+        *st = step;
+      }
+    }
+  }
+  nFrames++;
+  return true;
+}
+
+uint16_t OV5640_DepthMap::step(uint16_t x, uint16_t y) const {
+  size_t i = (size_t)y * tx + x;
+  if (!best[i] || best[i] < minScore) return OV5640_DEPTH_UNKNOWN;
+  return bestStep[i];
+}
+
+void OV5640_DepthMap::depthGrid(uint16_t* mm, const OV5640_FocusCal& cal) const {
+  for (uint16_t y = 0; y < ty; y++) {
+    for (uint16_t x = 0; x < tx; x++) {
+      uint16_t s = step(x, y);
+      *mm++ = s == OV5640_DEPTH_UNKNOWN ? OV5640_DEPTH_UNKNOWN : cal.distanceFor(s);
+    }
+  }
+}
@@ -0,0 +1,80 @@
+/*
+  ESP32_OV5640_depth.h - Depth from focus over lens sweeps
+  Released into the public domain.
+
+  Feed the frames of a focus sweep one at a time; every tile keeps the
+  lens step at which it was sharpest so far.  The per-tile steps turn
+  into distances through the same OV5640_FocusCal manualFocusDistance()
+  uses.  All state lives in an arena the caller provides, so add() never
+  allocates.
+*/
+
+#ifndef ESP32_OV5640_depth_h
+#define ESP32_OV5640_depth_h
+
+#include "ESP32_OV5640_sharpness.h"
+#include "ESP32_OV5640_focuscal.h"
+
+#define OV5640_DEPTH_UNKNOWN              0xFFFF   // tile without enough texture
+/* best score (4) + best step (2) per tile */
+#define OV5640_DEPTH_TILE_BYTES           6
+
+class OV5640_DepthMap {
+public:
+  OV5640_DepthMap();
+
+  /** Arena words needed for a width x height frame cut into tile x tile;
+   *  constexpr, so it can size a static array */
+  static constexpr size_t arenaWords(uint16_t width, uint16_t height, uint16_t tile) {
+    return tile ? (OV5640_DEPTH_TILE_BYTES * (size_t)((width + tile - 1) / tile) *
+                   ((height + tile - 1) / tile) + 3) / 4 : 0;
+  }
+  /** The same in bytes, a multiple of 4 */
+  static constexpr size_t arenaSize(uint16_t width, uint16_t height, uint16_t tile) {
+    return arenaWords(width, height, tile) * sizeof(uint32_t);
+  }
+
+  /**
+   * Lay the accumulator out in arena, e.g. a static uint32_t array of
+   * arenaWords() entries; size is in bytes.
+   * @returns false if the arena is smaller than arenaSize()
+   */
+  bool begin(uint32_t* arena, size_t size, uint16_t width, uint16_t height, uint16_t tile,
+             OV5640_SharpMetric metric = OV5640_SHARP_TENENGRAD);
+  /** Forget the sweep so far, keep the layout */
+  void reset();
+
+  /**
+   * Score every tile of a frame taken at lens step `step`.
+   * @returns false if the frame does not match the configured size
+   */
+  bool add(const OV5640_Frame& frame, uint16_t step);
+
+  /** Tiles whose best score stays below this are reported unknown */
+  void setMinScore(uint32_t score) { minScore = score; }
+
+  uint16_t tilesX() const { return tx; }
+  uint16_t tilesY() const { return ty; }
+  uint16_t frames() const { return nFrames; }
+
+  /** Sharpest step of a tile, OV5640_DEPTH_UNKNOWN if not textured */
+  uint16_t step(uint16_t x, uint16_t y) const;
+  uint32_t score(uint16_t x, uint16_t y) const { return best[y * tx + x]; }
+
+  /**
+   * Depth grid in mm, tilesX() * tilesY() entries, row-major; 0 means
+   * infinity and OV5640_DEPTH_UNKNOWN no texture.
+   */
+  void depthGrid(uint16_t* mm, const OV5640_FocusCal& cal = OV5640_FocusCal::defaults()) const;
+
+private:
+  uint32_t* best;
+  uint16_t* bestStep;
+  uint16_t width, height, tile;
+  uint16_t tx, ty;
+  uint16_t nFrames;
+  uint32_t minScore;
+  OV5640_SharpMetric metric;
+};
+
+#endif
@@ -0,0 +1,176 @@
+/*
+  ESP32_OV5640_focuscal.cpp - Per-module distance <-> lens step calibration
+  Released into the public domain.
+*/
+
+#include "ESP32_OV5640_focuscal.h"
+#include "ESP32_OV5640_softaf.h"
+
+/* Generic table {distance [mm] , VCM step} – 0 = infinity */
+static const OV5640_CalPoint dist_lut[] PROGMEM = {
+  {  0 ,   0  },   // infinity
+  {800 , 120  },
+  {400 , 260  },
+  {250 , 400  },
+  {150 , 540  },
+  {100 , 680  },
+  { 70 , 850  },
+  { 50 , 1023 }    // 5 cm  (closest)
+};
+
+static OV5640_FocusCal buildDefaults() {
+  OV5640_FocusCal cal;
+  for (uint8_t i = 0; i < sizeof(dist_lut) / sizeof(dist_lut[0]); i++)
+    cal.addPoint(dist_lut[i].distance_mm, dist_lut[i].step);
+  return cal;
+}
+
+const OV5640_FocusCal& OV5640_FocusCal::defaults() {
+  static const OV5640_FocusCal cal = buildDefaults();
+  return cal;
+}
+
+OV5640_FocusCal::OV5640_FocusCal() {
+  clear();
+  moduleId = 0;
+}
+
+void OV5640_FocusCal::clear() {
+  n = 0;
+}
+
+uint32_t OV5640_FocusCal::inverse(uint16_t distance_mm) {
+  return distance_mm ? (1UL << 24) / distance_mm : 0;
+}
+
+bool OV5640_FocusCal::addPoint(uint16_t distance_mm, uint16_t step) {
+  uint32_t x = inverse(distance_mm);
+  uint8_t i = 0;
+  while (i < n && inv[i] < x) i++;
+
+  if (i < n && inv[i] == x) {
+    pts[i].step = step;
+    return true;
+  }
+  if (n >= OV5640_CAL_MAX_POINTS) return false;
+
+  for (uint8_t j = n; j > i; j--) {
+    pts[j] = pts[j - 1];
+    inv[j] = inv[j - 1];
+  }
+  pts[i].distance_mm = distance_mm;
+  pts[i].step = step;
+  inv[i] = x;
+  n++;
+  return true;
+}
+
+/* a + (b - a) * num / den, rounded to nearest */
+static int32_t lerp(int32_t a, int32_t b, int64_t num, int64_t den) {
+  int64_t d = (int64_t)(b - a) * num;
+  return a + (int32_t)(d >= 0 ? (d + den / 2) / den : (d - den / 2) / den);
+}
+
+uint16_t OV5640_FocusCal::stepFor(uint16_t distance_mm) const {
+  if (!n) return 0;
+  uint32_t x = inverse(distance_mm);
+
+  /* first point at or nearer than the requested distance */
+  uint8_t lo = 0, hi = n;
+  while (lo < hi) {
+    uint8_t mid = (lo + hi) / 2;
+    if (inv[mid] < x) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == 0) return pts[0].step;
+  if (lo == n) return pts[n - 1].step;
+
+  uint32_t x0 = inv[lo - 1], x1 = inv[lo];
+  return lerp(pts[lo - 1].step, pts[lo].step, x - x0, x1 - x0);
+}
+
+/* Distances past 0xFFFE mm are infinity as far as the lens goes; 0xFFFF
+ * is left free for "no distance" (OV5640_DEPTH_UNKNOWN) */
+static uint16_t farAsInfinity(uint32_t mm) {
+  return mm > 0xFFFE ? 0 : (uint16_t)mm;
+}
+
+uint16_t OV5640_FocusCal::distanceFor(uint16_t step) const {
+  if (!n) return 0;
+
+  /* steps grow with 1/distance, so the table is sorted by step as well */
+  uint8_t lo = 0, hi = n;
+  while (lo < hi) {
+    uint8_t mid = (lo + hi) / 2;
+    if (pts[mid].step < step) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == 0) return farAsInfinity(pts[0].distance_mm);
+  if (lo == n) return farAsInfinity(pts[n - 1].distance_mm);
+
+  uint16_t s0 = pts[lo - 1].step, s1 = pts[lo].step;
+  int32_t x = lerp(inv[lo - 1], inv[lo], step - s0, s1 - s0);
+  return x > 0 ? farAsInfinity((1UL << 24) / x) : 0;
+}
+
+/********************  serialization  ********************/
+
+static uint16_t crc16(const uint8_t* p, size_t len) {
+  uint16_t crc = 0xFFFF;
+  while (len--) {
+    crc ^= (uint16_t)*p++ << 8;
+    for (uint8_t b = 0; b < 8; b++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+size_t OV5640_FocusCal::serialize(uint8_t* out, size_t cap) const {
+  size_t len = OV5640_CAL_BLOB_SIZE(n);
+  if (cap < len) return 0;
+
+  uint8_t* p = out;
+  *p++ = OV5640_CAL_MAGIC & 0xff;
+  *p++ = OV5640_CAL_MAGIC >> 8;
+  *p++ = OV5640_CAL_VERSION;
+  *p++ = n;
+  for (uint8_t b = 0; b < 4; b++) *p++ = (moduleId >> (8 * b)) & 0xff;
+  for (uint8_t i = 0; i < n; i++) {
+    *p++ = pts[i].distance_mm & 0xff;
+    *p++ = pts[i].distance_mm >> 8;
+    *p++ = pts[i].step & 0xff;
+    *p++ = pts[i].step >> 8;
+  }
+  uint16_t crc = crc16(out, p - out);
+  *p++ = crc & 0xff;
+  *p++ = crc >> 8;
+  return len;
+}
+
+bool OV5640_FocusCal::deserialize(const uint8_t* in, size_t len) {
+  if (!in || len < OV5640_CAL_BLOB_SIZE(0)) return false;
+  if ((in[0] | (in[1] << 8)) != OV5640_CAL_MAGIC || in[2] != OV5640_CAL_VERSION) return false;
+
+  uint8_t count = in[3];
+  size_t want = OV5640_CAL_BLOB_SIZE(count);
+  if (count > OV5640_CAL_MAX_POINTS || len < want) return false;
+  if (crc16(in, want - 2) != (in[want - 2] | (in[want - 1] << 8))) return false;
+
+  clear();
+  moduleId = 0;
+  for (uint8_t b = 0; b < 4; b++) moduleId |= (uint32_t)in[4 + b] << (8 * b);
+  const uint8_t* p = in + 8;
+  for (uint8_t i = 0; i < count; i++, p += 4)
+    addPoint(p[0] | (p[1] << 8), p[2] | (p[3] << 8));
+  return true;
+}
+
+/********************  calibration  ********************/
+
+uint8_t OV5640_FocusCal::calibrate(OV5640_SoftAF& af, uint16_t distance_mm, OV5640_SoftAFResult* result) {
+  OV5640_SoftAFResult res;
+  uint8_t rc = af.run(&res);
+  if (rc == 0 && !addPoint(distance_mm, res.step)) rc = OV5640_CAL_TABLE_FULL;
+  if (result) *result = res;
+  return rc;
+}
@@ -0,0 +1,80 @@
+/*
+  ESP32_OV5640_focuscal.h - Per-module distance <-> lens step calibration
+  Released into the public domain.
+
+  VCM position is close to linear in 1/distance, so the table is kept
+  sorted by inverse distance (Q24, 1/mm) and looked up with a binary
+  search plus fixed-point linear interpolation between the two
+  neighbouring points.  Distance 0 stands for infinity.
+*/
+
+#ifndef ESP32_OV5640_focuscal_h
+#define ESP32_OV5640_focuscal_h
+
+#include "ESP32_OV5640_port.h"
+#include "ESP32_OV5640_core.h"
+
+#define OV5640_CAL_MAX_POINTS             16
+#define OV5640_CAL_MAGIC                  0x4346   // "FC"
+#define OV5640_CAL_VERSION                1
+#define OV5640_CAL_TABLE_FULL             (OV5640_RC_CAL + 0)
+/* magic(2) version(1) count(1) moduleId(4) points(4 each) crc16(2) */
+#define OV5640_CAL_BLOB_SIZE(n)           (8 + 4 * (n) + 2)
+#define OV5640_CAL_BLOB_MAX               OV5640_CAL_BLOB_SIZE(OV5640_CAL_MAX_POINTS)
+
+class OV5640_SoftAF;
+struct OV5640_SoftAFResult;
+
+struct OV5640_CalPoint {
+  uint16_t distance_mm;   // 0 = infinity
+  uint16_t step;
+};
+
+class OV5640_FocusCal {
+public:
+  OV5640_FocusCal();
+
+  /** The generic table manualFocusDistance() used to snap to */
+  static const OV5640_FocusCal& defaults();
+
+  void clear();
+  /** Insert or replace the point for distance_mm; false when full */
+  bool addPoint(uint16_t distance_mm, uint16_t step);
+  uint8_t count() const { return n; }
+  const OV5640_CalPoint& point(uint8_t i) const { return pts[i]; }
+
+  /** Identifies the camera module the table belongs to */
+  void setModuleId(uint32_t id) { moduleId = id; }
+  uint32_t getModuleId() const { return moduleId; }
+
+  /** Interpolated lens step for an object distance (0 = infinity) */
+  uint16_t stepFor(uint16_t distance_mm) const;
+  /** Inverse mapping; 0 = infinity (step at or below the far end, or
+   *  beyond 0xFFFE mm), never 0xFFFF */
+  uint16_t distanceFor(uint16_t step) const;
+
+  /**
+   * Compact little-endian blob with CRC, suitable for NVS or flash.
+   * @returns bytes written, 0 if cap < OV5640_CAL_BLOB_SIZE(count())
+   */
+  size_t serialize(uint8_t* out, size_t cap) const;
+  /** Load a blob; the table is left untouched if it does not validate */
+  bool deserialize(const uint8_t* in, size_t len);
+
+  /**
+   * Calibrate one point: with a target at distance_mm in the ROI, run a
+   * contrast AF sweep and record the step it locks on.
+   * @returns the SoftAF result code, or OV5640_CAL_TABLE_FULL
+   */
+  uint8_t calibrate(OV5640_SoftAF& af, uint16_t distance_mm, OV5640_SoftAFResult* result = NULL);
+
+private:
+  static uint32_t inverse(uint16_t distance_mm);
+
+  OV5640_CalPoint pts[OV5640_CAL_MAX_POINTS];
+  uint32_t inv[OV5640_CAL_MAX_POINTS];   // Q24 1/distance, ascending
+  uint8_t n;
+  uint32_t moduleId;
+};
+
+#endif
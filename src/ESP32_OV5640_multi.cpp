@@ -0,0 +1,148 @@
+/*
+  ESP32_OV5640_multi.cpp - Several OV5640 modules driven in parallel
+  Released into the public domain.
+*/
+
+#include "ESP32_OV5640_multi.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#elif !defined(ARDUINO)
+#include <system_error>
+#endif
+
+OV5640_Manager::OV5640_Manager() {
+  n = 0;
+  job = JOB_FOCUS_INIT;
+  jobStep = 0;
+  jobForce = false;
+  for (uint8_t i = 0; i < OV5640_MAX_CAMERAS; i++) {
+    cams[i].owner = this;
+    cams[i].index = i;
+    cams[i].cam = NULL;
+    cams[i].state = OV5640_CAM_IDLE;
+    cams[i].rc = 0;
+    cams[i].us = 0;
+  }
+}
+
+OV5640_Manager::~OV5640_Manager() {
+  waitAll();
+}
+
+int OV5640_Manager::add(OV5640* cam) {
+  if (!cam || n >= OV5640_MAX_CAMERAS || busy()) return -1;
+  cams[n].cam = cam;
+  cams[n].state = OV5640_CAM_IDLE;
+  return n++;
+}
+
+bool OV5640_Manager::focusInitAll(bool forceReload) {
+  if (busy()) return false;
+  job = JOB_FOCUS_INIT;
+  jobForce = forceReload;
+  return runAll();
+}
+
+bool OV5640_Manager::autoFocusModeAll() {
+  if (busy()) return false;
+  job = JOB_AUTO_FOCUS;
+  return runAll();
+}
+
+bool OV5640_Manager::manualFocusAll(uint16_t step) {
+  if (busy()) return false;
+  job = JOB_MANUAL_FOCUS;
+  jobStep = step;
+  return runAll();
+}
+
+bool OV5640_Manager::runAll() {
+  /* reap threads of the previous round before reusing the slots */
+  waitAll();
+  bool ok = true;
+  for (uint8_t i = 0; i < n; i++) cams[i].state = OV5640_CAM_BUSY;
+  for (uint8_t i = 0; i < n; i++) {
+    if (!spawn(i)) {
+      cams[i].rc = OV5640_MULTI_NO_WORKER;
+      cams[i].state = OV5640_CAM_FAILED;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void OV5640_Manager::runJob(uint8_t i) {
+  OV5640* cam = cams[i].cam;
+  OV5640_Clock* clock = cam->getClock();
+  uint32_t t0 = clock->nowUs();
+  uint8_t rc;
+
+  switch (job) {
+    case JOB_FOCUS_INIT:   rc = cam->focusInit(jobForce); break;
+    case JOB_AUTO_FOCUS:   rc = cam->autoFocusMode(); break;
+    case JOB_MANUAL_FOCUS: rc = cam->manualFocus(jobStep); break;
+    default:               rc = OV5640_MULTI_BAD_JOB; break;
+  }
+
+  cams[i].us = clock->nowUs() - t0;
+  cams[i].rc = rc;
+  /* publishes rc and us to whoever sees the new state */
+  cams[i].state = rc == 0 ? OV5640_CAM_READY : OV5640_CAM_FAILED;
+}
+
+void OV5640_Manager::workerEntry(void* arg) {
+  Slot* slot = (Slot*)arg;
+  slot->owner->runJob(slot->index);
+#if defined(ARDUINO_ARCH_ESP32)
+  vTaskDelete(NULL);
+#endif
+}
+
+bool OV5640_Manager::spawn(uint8_t i) {
+  Slot* slot = &cams[i];
+#if defined(ARDUINO_ARCH_ESP32)
+  return xTaskCreate(workerEntry, "ov5640", OV5640_WORKER_STACK, slot,
+                     OV5640_WORKER_PRIORITY, NULL) == pdPASS;
+#elif !defined(ARDUINO)
+  /* std::thread throws when the system is out of threads; runAll() marks
+   * the camera failed instead of letting that escape */
+  try {
+    cams[i].worker = std::thread(workerEntry, (void*)slot);
+  } catch (const std::system_error&) {
+    return false;
+  }
+  return true;
+#else
+  /* no scheduler to hand the work to: run it in place */
+  workerEntry(slot);
+  return true;
+#endif
+}
+
+uint8_t OV5640_Manager::waitAll() {
+  uint8_t failed = 0;
+  for (uint8_t i = 0; i < n; i++) {
+#if !defined(ARDUINO)
+    if (cams[i].worker.joinable()) cams[i].worker.join();
+#else
+    while (cams[i].state == OV5640_CAM_BUSY) delay(1);
+#endif
+    if (cams[i].state == OV5640_CAM_FAILED) failed++;
+  }
+  return failed;
+}
+
+bool OV5640_Manager::busy() const {
+  for (uint8_t i = 0; i < n; i++)
+    if (cams[i].state == OV5640_CAM_BUSY) return true;
+  return false;
+}
+
+bool OV5640_Manager::allReady() const {
+  if (!n) return false;
+  for (uint8_t i = 0; i < n; i++)
+    if (cams[i].state != OV5640_CAM_READY) return false;
+  return true;
+}
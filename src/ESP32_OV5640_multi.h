@@ -0,0 +1,93 @@
+/*
+  ESP32_OV5640_multi.h - Several OV5640 modules driven in parallel
+  Released into the public domain.
+
+  Each camera needs its own bus or transport (esp32-camera itself only
+  drives one sensor): e.g. OV5640_WireTransport on separate I2C ports or
+  behind a mux, or one simulator per camera on the host.  Operations run
+  on one worker per camera, FreeRTOS tasks on the ESP32 and std::thread on
+  a host build, so firmware uploads overlap instead of queueing up.
+*/
+
+#ifndef ESP32_OV5640_multi_h
+#define ESP32_OV5640_multi_h
+
+#include "ESP32_OV5640_AF.h"
+#include <atomic>
+
+#if !defined(ARDUINO)
+#include <thread>
+#endif
+
+#define OV5640_MAX_CAMERAS                8
+#define OV5640_WORKER_STACK               4096
+#define OV5640_WORKER_PRIORITY            2
+#define OV5640_MULTI_NO_WORKER            (OV5640_RC_MULTI + 0)   // task / thread not started
+#define OV5640_MULTI_BAD_JOB              (OV5640_RC_MULTI + 1)   // worker given no operation
+
+enum OV5640_CamState {
+  OV5640_CAM_IDLE,        // added, nothing run yet
+  OV5640_CAM_BUSY,        // worker running
+  OV5640_CAM_READY,       // last operation returned 0
+  OV5640_CAM_FAILED       // last operation returned an error
+};
+
+class OV5640_Manager {
+public:
+  OV5640_Manager();
+  ~OV5640_Manager();
+
+  /** Add a camera that start() already accepted; @returns index or -1 */
+  int add(OV5640* cam);
+  uint8_t count() const { return n; }
+  OV5640* camera(uint8_t i) { return i < n ? cams[i].cam : NULL; }
+
+  /**
+   * Start the operation on every camera at once and return.  false if a
+   * previous operation is still running or a worker could not be started
+   * (that camera is marked failed).
+   */
+  bool focusInitAll(bool forceReload = false);
+  bool autoFocusModeAll();
+  bool manualFocusAll(uint16_t step);
+
+  /** Block until every worker has finished; @returns cameras that failed */
+  uint8_t waitAll();
+
+  bool busy() const;
+  /** Every camera finished its last operation successfully */
+  bool allReady() const;
+  OV5640_CamState state(uint8_t i) const { return (OV5640_CamState)cams[i].state.load(); }
+  /** Return code of the camera's last operation, OV5640_MULTI_* if it did not run */
+  uint8_t result(uint8_t i) const { return cams[i].rc; }
+  /** Duration of the camera's last operation on its own clock */
+  uint32_t durationUs(uint8_t i) const { return cams[i].us; }
+
+private:
+  enum Job { JOB_FOCUS_INIT, JOB_AUTO_FOCUS, JOB_MANUAL_FOCUS };
+
+  struct Slot {
+    OV5640_Manager* owner;
+    uint8_t index;
+    OV5640* cam;
+    std::atomic<uint8_t> state;
+    uint8_t rc;
+    uint32_t us;
+#if !defined(ARDUINO)
+    std::thread worker;
+#endif
+  };
+
+  bool runAll();
+  bool spawn(uint8_t i);
+  void runJob(uint8_t i);
+  static void workerEntry(void* arg);
+
+  Slot cams[OV5640_MAX_CAMERAS];
+  uint8_t n;
+  Job job;
+  uint16_t jobStep;
+  bool jobForce;
+};
+
+#endif
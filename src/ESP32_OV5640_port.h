@@ -0,0 +1,78 @@
+/*
+  ESP32_OV5640_port.h - Platform layer for the OV5640 AF library
+  Released into the public domain.
+
+  On Arduino this pulls in Arduino.h and esp32-camera.  Anywhere else
+  (Linux host builds against the simulator) it provides the few pieces
+  the library uses: delay/millis/micros, PROGMEM and a minimal sensor_t.
+*/
+
+#ifndef ESP32_OV5640_port_h
+#define ESP32_OV5640_port_h
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+#include "esp_camera.h"
+
+#else
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+
+inline unsigned long micros() {
+  using namespace std::chrono;
+  static const steady_clock::time_point t0 = steady_clock::now();
+  return (unsigned long)duration_cast<microseconds>(steady_clock::now() - t0).count();
+}
+
+inline unsigned long millis() {
+  return micros() / 1000;
+}
+
+inline void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+/* Register access subset of esp32-camera's sensor_t */
+typedef struct _sensor sensor_t;
+struct _sensor {
+  int (*get_reg)(sensor_t* sensor, int reg, int mask);
+  int (*set_reg)(sensor_t* sensor, int reg, int mask, int value);
+};
+
+#endif
+
+/**
+ * Time source for the poll loops.  The default uses micros()/delay(); the
+ * simulator substitutes virtual time so off-target runs finish instantly.
+ */
+class OV5640_Clock {
+public:
+  virtual ~OV5640_Clock() {}
+  virtual uint32_t nowUs() { return micros(); }
+  virtual void sleepMs(uint32_t ms) { delay(ms); }
+  virtual void sleepUs(uint32_t us) {
+#if defined(ARDUINO)
+    if (us >= 1000) delay(us / 1000);
+    delayMicroseconds(us % 1000);
+#else
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+#endif
+  }
+
+  /** Shared default instance */
+  static OV5640_Clock* system() {
+    static OV5640_Clock clk;
+    return &clk;
+  }
+};
+
+#endif
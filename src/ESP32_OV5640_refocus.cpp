@@ -0,0 +1,177 @@
+/*
+  ESP32_OV5640_refocus.cpp - Scene-change gated refocus
+  Released into the public domain.
+*/
+
+#include "ESP32_OV5640_refocus.h"
+#include "ESP32_OV5640_softaf.h"
+
+OV5640_Refocus::OV5640_Refocus(OV5640& _cam, OV5640_SoftAF* _soft)
+  : cam(_cam), soft(_soft) {
+  configure(defaultConfig());
+  resetStats();
+  st = OV5640_REFOCUS_LOCKED;
+  needRef = true;
+  run = 0;
+  rc = 0;
+  lastLuma = 0;
+  refSharp = 0;
+  refJpeg = prevJpeg = 0;
+  memset(ref, 0, sizeof(ref));
+  memset(prev, 0, sizeof(prev));
+  memset(cur, 0, sizeof(cur));
+}
+
+OV5640_RefocusConfig OV5640_Refocus::defaultConfig() {
+  OV5640_RefocusConfig c;
+  c.thumbW = OV5640_THUMB_MAX_W;
+  c.thumbH = OV5640_THUMB_MAX_H;
+  c.lumaEnter = 12;
+  c.lumaSettle = 4;
+  c.sharpDropPercent = 25;
+  c.jpegDeltaPercent = 20;
+  c.enterFrames = 3;
+  c.settleFrames = 5;
+  c.softAF = false;
+  c.metric = OV5640_SHARP_TENENGRAD;
+  c.roiX = 0.25f;
+  c.roiY = 0.25f;
+  c.roiW = 0.5f;
+  c.roiH = 0.5f;
+  return c;
+}
+
+void OV5640_Refocus::configure(const OV5640_RefocusConfig& _cfg) {
+  cfg = _cfg;
+  if (cfg.thumbW < 1) cfg.thumbW = 1;
+  if (cfg.thumbH < 1) cfg.thumbH = 1;
+  if (cfg.thumbW > OV5640_THUMB_MAX_W) cfg.thumbW = OV5640_THUMB_MAX_W;
+  if (cfg.thumbH > OV5640_THUMB_MAX_H) cfg.thumbH = OV5640_THUMB_MAX_H;
+  needRef = true;
+}
+
+void OV5640_Refocus::resetStats() {
+  memset(&counters, 0, sizeof(counters));
+}
+
+uint8_t OV5640_Refocus::begin() {
+  return refocus();
+}
+
+uint8_t OV5640_Refocus::refocus() {
+  if (cfg.softAF && soft) rc = soft->run();
+  else rc = cam.singleAutoFocus();
+
+  counters.refocuses++;
+  if (rc) counters.failures++;
+  st = OV5640_REFOCUS_LOCKED;
+  needRef = true;
+  run = 0;
+  return rc;
+}
+
+/* Mean luma per cell, from every OV5640_THUMB_SAMPLE-th pixel */
+void OV5640_Refocus::thumbnail(const OV5640_Frame& f, uint8_t* out) const {
+  uint8_t px = f.format == OV5640_FRAME_YUV422 ? 2 : 1;
+  for (uint8_t cy = 0; cy < cfg.thumbH; cy++) {
+    uint16_t y0 = (uint32_t)f.height * cy / cfg.thumbH;
+    uint16_t y1 = (uint32_t)f.height * (cy + 1) / cfg.thumbH;
+    for (uint8_t cx = 0; cx < cfg.thumbW; cx++) {
+      uint16_t x0 = (uint32_t)f.width * cx / cfg.thumbW;
+      uint16_t x1 = (uint32_t)f.width * (cx + 1) / cfg.thumbW;
+      uint32_t sum = 0, n = 0;
+      for (uint16_t y = y0; y < y1; y += OV5640_THUMB_SAMPLE) {
+        const uint8_t* row = f.data + (size_t)y * f.stride;
+        for (uint16_t x = x0; x < x1; x += OV5640_THUMB_SAMPLE) {
+          sum += row[x * px];
+          n++;
+        }
+      }
+      *out++ = n ? sum / n : 0;
+    }
+  }
+}
+
+uint8_t OV5640_Refocus::thumbDiff(const uint8_t* a, const uint8_t* b) const {
+  uint16_t n = cfg.thumbW * cfg.thumbH;
+  uint32_t sum = 0;
+  for (uint16_t i = 0; i < n; i++) sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+  return sum / n;
+}
+
+/* |now - ref| >= percent of ref; never true without both sizes */
+bool OV5640_Refocus::sizeMoved(uint32_t now, uint32_t ref, uint8_t percent) {
+  if (!percent || !now || !ref) return false;
+  uint32_t d = now > ref ? now - ref : ref - now;
+  return (uint64_t)d * 100 >= (uint64_t)ref * percent;
+}
+
+bool OV5640_Refocus::update(uint32_t jpegBytes) {
+  OV5640_Frame none;
+  memset(&none, 0, sizeof(none));
+  return update(none, jpegBytes);
+}
+
+bool OV5640_Refocus::update(const OV5640_Frame& frame, uint32_t jpegBytes) {
+  counters.frames++;
+  bool pixels = frame.data != NULL && frame.width >= 3 && frame.height >= 3;
+  uint32_t sharp = 0;
+  if (pixels) {
+    thumbnail(frame, cur);
+    OV5640_Rect r = OV5640_Sharpness::roi(frame, cfg.roiX, cfg.roiY, cfg.roiW, cfg.roiH);
+    sharp = OV5640_Sharpness::score(cfg.metric, frame, r);
+  }
+
+  if (needRef) {
+    memcpy(ref, cur, sizeof(ref));
+    memcpy(prev, cur, sizeof(prev));
+    refSharp = sharp;
+    refJpeg = prevJpeg = jpegBytes;
+    lastLuma = 0;
+    needRef = false;
+    run = 0;
+    return false;
+  }
+
+  /* against the reference: has the scene moved away from what we focused on? */
+  bool differs = false;
+  if (pixels) {
+    lastLuma = thumbDiff(cur, ref);
+    differs = lastLuma >= cfg.lumaEnter;
+    if (cfg.sharpDropPercent && refSharp &&
+        (uint64_t)sharp * 100 < (uint64_t)refSharp * (100 - cfg.sharpDropPercent))
+      differs = true;
+  }
+  if (sizeMoved(jpegBytes, refJpeg, cfg.jpegDeltaPercent)) differs = true;
+
+  bool refocused = false;
+  if (st == OV5640_REFOCUS_LOCKED) {
+    run = differs ? run + 1 : 0;
+    if (run >= cfg.enterFrames) {
+      st = OV5640_REFOCUS_CHANGED;
+      counters.changes++;
+      run = 0;
+    }
+  } else {
+    /* against the previous frame: has it stopped moving? */
+    bool still = true;
+    if (pixels && thumbDiff(cur, prev) > cfg.lumaSettle) still = false;
+    if (sizeMoved(jpegBytes, prevJpeg, cfg.jpegDeltaPercent / 2)) still = false;
+
+    run = still ? run + 1 : 0;
+    if (run >= cfg.settleFrames) {
+      if (differs) {
+        refocus();
+        refocused = true;
+      } else {
+        /* settled back to what we focused on, e.g. something passed by */
+        st = OV5640_REFOCUS_LOCKED;
+        run = 0;
+      }
+    }
+  }
+
+  memcpy(prev, cur, sizeof(prev));
+  prevJpeg = jpegBytes;
+  return refocused;
+}
@@ -0,0 +1,104 @@
+/*
+  ESP32_OV5640_refocus.h - Scene-change gated refocus
+  Released into the public domain.
+
+  An alternative to continuous AF: focus once, hold the lens, and watch
+  cheap statistics of the frames the application grabs anyway - a small
+  luminance thumbnail, ROI sharpness and optionally the JPEG size.  When
+  they move away from the values at lock for enterFrames frames in a
+  row, the scene counts as changed; once it has been still again for
+  settleFrames frames, one single-shot (or software) AF runs and the
+  next frame becomes the new reference.
+*/
+
+#ifndef ESP32_OV5640_refocus_h
+#define ESP32_OV5640_refocus_h
+
+#include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_sharpness.h"
+
+class OV5640_SoftAF;
+
+#define OV5640_THUMB_MAX_W                16
+#define OV5640_THUMB_MAX_H                12
+#define OV5640_THUMB_SAMPLE               4      // every 4th pixel, both axes
+
+enum OV5640_RefocusState {
+  OV5640_REFOCUS_LOCKED,      // comparing frames against the reference
+  OV5640_REFOCUS_CHANGED      // scene changed, waiting for it to settle
+};
+
+struct OV5640_RefocusConfig {
+  uint8_t thumbW, thumbH;       // luminance thumbnail grid
+  uint8_t lumaEnter;            // mean |thumbnail - reference| that is a change
+  uint8_t lumaSettle;           // frame-to-frame mean |diff| that is still
+  uint8_t sharpDropPercent;     // sharpness loss vs lock that is a change, 0 = off
+  uint8_t jpegDeltaPercent;     // JPEG size change vs lock that is a change, 0 = off
+  uint8_t enterFrames;          // changed frames in a row before acting
+  uint8_t settleFrames;         // still frames in a row before refocusing
+  bool softAF;                  // refocus with OV5640_SoftAF, not single-shot AF
+  OV5640_SharpMetric metric;
+  float roiX, roiY, roiW, roiH; // normalized sharpness ROI
+};
+
+struct OV5640_RefocusStats {
+  uint32_t frames;
+  uint32_t changes;             // scene changes detected
+  uint32_t refocuses;
+  uint32_t failures;            // refocuses that returned an error
+};
+
+class OV5640_Refocus {
+public:
+  /** soft is only needed with config().softAF */
+  OV5640_Refocus(OV5640& _cam, OV5640_SoftAF* _soft = NULL);
+
+  /** 16x12 thumbnail, Tenengrad on the centre quarter, single-shot AF */
+  static OV5640_RefocusConfig defaultConfig();
+  void configure(const OV5640_RefocusConfig& _cfg);
+  const OV5640_RefocusConfig& config() const { return cfg; }
+
+  /** Focus once and lock; the next frame becomes the reference */
+  uint8_t begin();
+
+  /**
+   * Feed one frame, with its JPEG size if the stream is compressed (the
+   * pixel statistics are skipped when frame.data is NULL).
+   * @returns true if this call refocused
+   */
+  bool update(const OV5640_Frame& frame, uint32_t jpegBytes = 0);
+  /** JPEG-only streams: the size is the one statistic available */
+  bool update(uint32_t jpegBytes);
+
+  OV5640_RefocusState state() const { return st; }
+  uint8_t lastResult() const { return rc; }
+  /** Thumbnail difference to the reference of the last frame, 0..255 */
+  uint8_t lumaChange() const { return lastLuma; }
+  const OV5640_RefocusStats& stats() const { return counters; }
+  void resetStats();
+
+private:
+  void thumbnail(const OV5640_Frame& f, uint8_t* out) const;
+  uint8_t thumbDiff(const uint8_t* a, const uint8_t* b) const;
+  static bool sizeMoved(uint32_t now, uint32_t ref, uint8_t percent);
+  uint8_t refocus();
+
+  OV5640& cam;
+  OV5640_SoftAF* soft;
+  OV5640_RefocusConfig cfg;
+  OV5640_RefocusStats counters;
+
+  OV5640_RefocusState st;
+  bool needRef;
+  uint8_t run;                  // frames in a row meeting the current test
+  uint8_t rc;
+  uint8_t lastLuma;
+
+  uint8_t ref[OV5640_THUMB_MAX_W * OV5640_THUMB_MAX_H];
+  uint8_t prev[OV5640_THUMB_MAX_W * OV5640_THUMB_MAX_H];
+  uint8_t cur[OV5640_THUMB_MAX_W * OV5640_THUMB_MAX_H];
+  uint32_t refSharp;
+  uint32_t refJpeg, prevJpeg;
+};
+
+#endif
@@ -0,0 +1,132 @@
+/*
+  ESP32_OV5640_seq.h - Register sequences as data
+  Released into the public domain.
+
+  A sequence is a constexpr array of OV5640_SeqOp: register writes,
+  masked (read-modify-write) writes, waits for a register value and
+  delays.  The player (OV5640_Core::play(), OV5640::playSequence())
+  collects the plain writes between two barriers, keeps only the last
+  value written to each register, folds masked writes into it and sends
+  what is left in table order: a register written again goes out where
+  its last write stands.  Runs of adjacent registers that are already
+  consecutive in the table go out as one sequential write when the bus
+  has them.
+
+  Barriers keep their place: waits, delays (OV5640_Seq::barrier() is a
+  zero delay) and writes to trigger registers - the AF command block,
+  MCU reset, system control and group hold - which are never dropped or
+  merged.  Sensor mode tables (PLL, timing, format) depend on the order
+  of their writes, so the player never reorders them on its own; only
+  the writes after OV5640_Seq::unordered(), up to the next barrier, are
+  sent sorted by address, which merges more of them.
+*/
+
+#ifndef ESP32_OV5640_seq_h
+#define ESP32_OV5640_seq_h
+
+#include "ESP32_OV5640_port.h"
+#include "ESP32_OV5640_cfg.h"
+
+#define OV5640_SYSTEM_CTRL0               0x3008 // software reset / power down
+#define OV5640_GROUP_ACCESS               0x3212 // group hold start / end / launch
+
+#define OV5640_SEQ_MAX_PENDING            64     // plain writes held before a flush
+
+enum OV5640_SeqOpcode {
+  OV5640_SEQ_END,
+  OV5640_SEQ_WRITE,         // reg = val
+  OV5640_SEQ_MASK,          // reg = (reg & ~mask) | (val & mask)
+  OV5640_SEQ_WAIT,          // until (reg & mask) == val, ms timeout (0 = default)
+  OV5640_SEQ_DELAY,         // ms
+  OV5640_SEQ_UNORDERED      // the writes up to the next barrier may go out sorted
+};
+
+struct OV5640_SeqOp {
+  uint8_t op;
+  uint8_t val;
+  uint8_t mask;
+  uint16_t reg;
+  uint16_t ms;
+};
+
+/* What the player sent and saved */
+struct OV5640_SeqStats {
+  uint32_t ops;             // write and masked-write ops played
+  uint32_t writes;          // register bytes written
+  uint32_t transactions;    // write transactions (a burst is one)
+  uint32_t reads;           // reads for masked writes with no known value
+  uint32_t dropped;         // writes overwritten before the next barrier
+};
+
+/** Sequence builders, all usable in constexpr tables */
+struct OV5640_Seq {
+  static constexpr OV5640_SeqOp write(uint16_t reg, uint8_t val) {
+    return OV5640_SeqOp{ OV5640_SEQ_WRITE, val, 0xff, reg, 0 };
+  }
+  static constexpr OV5640_SeqOp mask(uint16_t reg, uint8_t bits, uint8_t val) {
+    return OV5640_SeqOp{ OV5640_SEQ_MASK, val, bits, reg, 0 };
+  }
+  static constexpr OV5640_SeqOp waitFor(uint16_t reg, uint8_t val, uint8_t bits = 0xff,
+                                        uint16_t timeoutMs = 0) {
+    return OV5640_SeqOp{ OV5640_SEQ_WAIT, val, bits, reg, timeoutMs };
+  }
+  static constexpr OV5640_SeqOp delay(uint16_t ms) {
+    return OV5640_SeqOp{ OV5640_SEQ_DELAY, 0, 0, 0, ms };
+  }
+  static constexpr OV5640_SeqOp barrier() { return delay(0); }
+  /** Opt in to sorting the writes up to the next barrier by address */
+  static constexpr OV5640_SeqOp unordered() {
+    return OV5640_SeqOp{ OV5640_SEQ_UNORDERED, 0, 0, 0, 0 };
+  }
+  static constexpr OV5640_SeqOp end() { return OV5640_SeqOp{ OV5640_SEQ_END, 0, 0, 0, 0 }; }
+
+  /** Writes that act on their own: always sent, in order, one by one */
+  static constexpr bool isTrigger(uint16_t reg) {
+    return reg == OV5640_CMD_MAIN || reg == OV5640_CMD_ACK || reg == OV5640_CMD_FW_STATUS ||
+           reg == OV5640_MCU_RESET || reg == OV5640_SYSTEM_CTRL0 || reg == OV5640_GROUP_ACCESS;
+  }
+};
+
+/********************  AF presets  ********************/
+
+/* After the firmware upload: clear the command block, mark the firmware as
+ * starting, take the MCU out of reset and wait for it to go idle.  PARA0..4
+ * go out as one sequential write. */
+static constexpr OV5640_SeqOp OV5640_SEQ_FW_RELEASE[] = {
+  OV5640_Seq::write(OV5640_CMD_MAIN, 0x00),
+  OV5640_Seq::write(OV5640_CMD_ACK, 0x00),
+  OV5640_Seq::write(OV5640_CMD_PARA0, 0x00),
+  OV5640_Seq::write(OV5640_CMD_PARA1, 0x00),
+  OV5640_Seq::write(OV5640_CMD_PARA2, 0x00),
+  OV5640_Seq::write(OV5640_CMD_PARA3, 0x00),
+  OV5640_Seq::write(OV5640_CMD_PARA4, 0x00),
+  OV5640_Seq::write(OV5640_CMD_FW_STATUS, FW_STATUS_S_FIRMWARE),
+  OV5640_Seq::write(OV5640_MCU_RESET, 0x00),
+  OV5640_Seq::waitFor(OV5640_CMD_FW_STATUS, FW_STATUS_S_IDLE),
+};
+
+/* autoFocusMode(): release the lens, then continuous AF */
+static constexpr OV5640_SeqOp OV5640_SEQ_AF_CONTINUOUS[] = {
+  OV5640_Seq::write(OV5640_CMD_MAIN, 0x01),
+  OV5640_Seq::write(OV5640_CMD_MAIN, AF_RELEASE_FOCUS),
+  OV5640_Seq::waitFor(OV5640_CMD_ACK, 0x00),
+  OV5640_Seq::write(OV5640_CMD_ACK, 0x01),
+  OV5640_Seq::write(OV5640_CMD_MAIN, AF_CONTINUE_AUTO_FOCUS),
+  OV5640_Seq::waitFor(OV5640_CMD_ACK, 0x00),
+};
+
+/* Stop focusing and hold the lens where it is */
+static constexpr OV5640_SeqOp OV5640_SEQ_AF_PAUSE[] = {
+  OV5640_Seq::write(OV5640_CMD_ACK, 0x01),
+  OV5640_Seq::write(OV5640_CMD_MAIN, AF_PAUSE_AUTO_FOCUS),
+  OV5640_Seq::waitFor(OV5640_CMD_ACK, 0x00),
+};
+
+/* Stop focusing and return the lens to its rest position */
+static constexpr OV5640_SeqOp OV5640_SEQ_AF_RELEASE[] = {
+  OV5640_Seq::write(OV5640_CMD_ACK, 0x01),
+  OV5640_Seq::write(OV5640_CMD_MAIN, AF_RELEASE_FOCUS),
+  OV5640_Seq::waitFor(OV5640_CMD_ACK, 0x00),
+};
+
+#endif
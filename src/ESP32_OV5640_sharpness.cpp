@@ -0,0 +1,204 @@
+/*
+  ESP32_OV5640_sharpness.cpp - Frame sharpness metrics for contrast AF
+  Released into the public domain.
+*/
+
+#include "ESP32_OV5640_sharpness.h"
+
+OV5640_Rect OV5640_Sharpness::roi(const OV5640_Frame& f, float x, float y, float w, float h) {
+  OV5640_Rect r = { 0, 0, 0, 0 };
+  if (f.width < 3 || f.height < 3) return r;
+
+  int x0 = (int)(x * f.width), y0 = (int)(y * f.height);
+  int x1 = (int)((x + w) * f.width), y1 = (int)((y + h) * f.height);
+  if (x0 < 1) x0 = 1;
+  if (y0 < 1) y0 = 1;
+  if (x1 > f.width - 1) x1 = f.width - 1;
+  if (y1 > f.height - 1) y1 = f.height - 1;
+  if (x1 <= x0 || y1 <= y0) return r;
+
+  r.x = x0;
+  r.y = y0;
+  r.w = x1 - x0;
+  r.h = y1 - y0;
+  return r;
+}
+
+OV5640_Rect OV5640_Sharpness::tile(const OV5640_Frame& f, uint16_t size, uint16_t tx, uint16_t ty) {
+  OV5640_Rect r = { 0, 0, 0, 0 };
+  if (f.width < 3 || f.height < 3) return r;
+
+  int x0 = tx * size, y0 = ty * size;
+  int x1 = x0 + size, y1 = y0 + size;
+  if (x0 < 1) x0 = 1;
+  if (y0 < 1) y0 = 1;
+  if (x1 > f.width - 1) x1 = f.width - 1;
+  if (y1 > f.height - 1) y1 = f.height - 1;
+  if (x1 <= x0 || y1 <= y0) return r;
+
+  r.x = x0;
+  r.y = y0;
+  r.w = x1 - x0;
+  r.h = y1 - y0;
+  return r;
+}
+
+uint32_t OV5640_Sharpness::score(OV5640_SharpMetric m, const OV5640_Frame& f, const OV5640_Rect& r) {
+  return m == OV5640_SHARP_LAPLACIAN ? laplacianVar(f, r) : tenengrad(f, r);
+}
+
+/********************  row kernels  ********************/
+
+/* S = bytes between horizontally adjacent luma samples */
+template <int S>
+static uint64_t tenengradRows(const uint8_t* base, size_t stride, const OV5640_Rect& r) {
+  uint64_t sum = 0;
+  for (uint16_t y = r.y; y < r.y + r.h; y++) {
+    const uint8_t* __restrict__ p0 = base + (y - 1) * stride + (r.x - 1) * S;
+    const uint8_t* __restrict__ p1 = p0 + stride;
+    const uint8_t* __restrict__ p2 = p1 + stride;
+    uint64_t row = 0;
+    for (uint16_t i = 0; i < r.w; i++) {
+      int32_t a = p0[i * S], b = p0[(i + 1) * S], c = p0[(i + 2) * S];
+      int32_t d = p1[i * S],                      e = p1[(i + 2) * S];
+      int32_t g = p2[i * S], h = p2[(i + 1) * S], k = p2[(i + 2) * S];
+      int32_t gx = (c + 2 * e + k) - (a + 2 * d + g);
+      int32_t gy = (g + 2 * h + k) - (a + 2 * b + c);
+      row += (uint32_t)(gx * gx + gy * gy);
+    }
+    sum += row;
+  }
+  return sum;
+}
+
+/* |l| <= 1020, so the squares of this many pixels still fit a uint32_t */
+#define LAPLACIAN_CHUNK 4096
+
+/* The inner loop keeps both partial sums 32-bit so it vectorises; they are
+ * widened once per row (per chunk on rows over LAPLACIAN_CHUNK pixels) */
+template <int S>
+static void laplacianRows(const uint8_t* base, size_t stride, const OV5640_Rect& r,
+                          int64_t& sum, uint64_t& sumSq) {
+  sum = 0;
+  sumSq = 0;
+  for (uint16_t y = r.y; y < r.y + r.h; y++) {
+    for (uint32_t x0 = 0; x0 < r.w; x0 += LAPLACIAN_CHUNK) {
+      uint32_t n = r.w - x0 < LAPLACIAN_CHUNK ? r.w - x0 : LAPLACIAN_CHUNK;
+      const uint8_t* __restrict__ p0 = base + (y - 1) * stride + (r.x + x0) * S;
+      const uint8_t* __restrict__ p1 = p0 + stride;
+      const uint8_t* __restrict__ p2 = p1 + stride;
+      int32_t rowSum = 0;
+      uint32_t rowSq = 0;
+      for (int32_t i = 0; i < (int32_t)n; i++) {
+        int32_t l = 4 * p1[i * S] - p0[i * S] - p2[i * S] - p1[(i - 1) * S] - p1[(i + 1) * S];
+        rowSum += l;
+        rowSq += (uint32_t)(l * l);
+      }
+      sum += rowSum;
+      sumSq += rowSq;
+    }
+  }
+}
+
+static uint32_t variance(int64_t sum, uint64_t sumSq, uint32_t n) {
+  double mean = (double)sum / n;
+  double var = (double)sumSq / n - mean * mean;
+  return var > 0 ? (uint32_t)(var + 0.5) : 0;
+}
+
+uint32_t OV5640_Sharpness::tenengrad(const OV5640_Frame& f, const OV5640_Rect& r) {
+  uint32_t n = (uint32_t)r.w * r.h;
+  if (!n) return 0;
+  uint64_t sum = f.format == OV5640_FRAME_YUV422
+    ? tenengradRows<2>(f.data, f.stride, r)
+    : tenengradRows<1>(f.data, f.stride, r);
+  return (uint32_t)(sum / n);
+}
+
+uint32_t OV5640_Sharpness::laplacianVar(const OV5640_Frame& f, const OV5640_Rect& r) {
+  uint32_t n = (uint32_t)r.w * r.h;
+  if (!n) return 0;
+  int64_t sum;
+  uint64_t sumSq;
+  if (f.format == OV5640_FRAME_YUV422)
+    laplacianRows<2>(f.data, f.stride, r, sum, sumSq);
+  else
+    laplacianRows<1>(f.data, f.stride, r, sum, sumSq);
+  return variance(sum, sumSq, n);
+}
+
+/********************  scalar reference  ********************/
+
+static inline int32_t luma(const OV5640_Frame& f, int x, int y) {
+  if (f.format == OV5640_FRAME_YUV422) return f.data[y * f.stride + x * 2];
+  return f.data[y * f.stride + x];
+}
+
+uint32_t OV5640_Sharpness::tenengradRef(const OV5640_Frame& f, const OV5640_Rect& r) {
+  static const int8_t kx[3][3] = { { -1, 0, 1 }, { -2, 0, 2 }, { -1, 0, 1 } };
+  static const int8_t ky[3][3] = { { -1, -2, -1 }, { 0, 0, 0 }, { 1, 2, 1 } };
+  uint32_t n = (uint32_t)r.w * r.h;
+  if (!n) return 0;
+
+  uint64_t sum = 0;
+  for (int y = r.y; y < r.y + r.h; y++) {
+    for (int x = r.x; x < r.x + r.w; x++) {
+      int32_t gx = 0, gy = 0;
+      for (int j = -1; j <= 1; j++) {
+        for (int i = -1; i <= 1; i++) {
+          int32_t v = luma(f, x + i, y + j);
+          gx += kx[j + 1][i + 1] * v;
+          gy += ky[j + 1][i + 1] * v;
+        }
+      }
+      sum += (uint32_t)(gx * gx + gy * gy);
+    }
+  }
+  return (uint32_t)(sum / n);
+}
+
+uint32_t OV5640_Sharpness::laplacianVarRef(const OV5640_Frame& f, const OV5640_Rect& r) {
+  uint32_t n = (uint32_t)r.w * r.h;
+  if (!n) return 0;
+
+  int64_t sum = 0;
+  uint64_t sumSq = 0;
+  for (int y = r.y; y < r.y + r.h; y++) {
+    for (int x = r.x; x < r.x + r.w; x++) {
+      int32_t l = 4 * luma(f, x, y) - luma(f, x, y - 1) - luma(f, x, y + 1)
+                - luma(f, x - 1, y) - luma(f, x + 1, y);
+      sum += l;
+      sumSq += (uint32_t)(l * l);
+    }
+  }
+  return variance(sum, sumSq, n);
+}
+
+/********************  camera frames  ********************/
+#if defined(ARDUINO)
+
+bool OV5640_CameraFrameSource::grab(OV5640_Frame& frame) {
+  camera_fb_t* fb = esp_camera_fb_get();
+  if (!fb) return false;
+  if (fb->format != PIXFORMAT_GRAYSCALE && fb->format != PIXFORMAT_YUV422) {
+    esp_camera_fb_return(fb);
+    return false;
+  }
+  frame.format = fb->format == PIXFORMAT_YUV422 ? OV5640_FRAME_YUV422 : OV5640_FRAME_GRAY;
+  frame.data = fb->buf;
+  frame.width = fb->width;
+  frame.height = fb->height;
+  frame.stride = fb->width * (frame.format == OV5640_FRAME_YUV422 ? 2 : 1);
+  frame.handle = fb;
+  /* the frame is in memory: the lens may move while the caller works on it */
+  exposed();
+  return true;
+}
+
+void OV5640_CameraFrameSource::release(OV5640_Frame& frame) {
+  if (frame.handle) esp_camera_fb_return((camera_fb_t*)frame.handle);
+  frame.handle = NULL;
+  frame.data = NULL;
+}
+
+#endif
@@ -0,0 +1,110 @@
+/*
+  ESP32_OV5640_sharpness.h - Frame sharpness metrics for contrast AF
+  Released into the public domain.
+*/
+
+#ifndef ESP32_OV5640_sharpness_h
+#define ESP32_OV5640_sharpness_h
+
+#include "ESP32_OV5640_port.h"
+
+enum OV5640_FrameFormat {
+  OV5640_FRAME_GRAY,      // 1 byte per pixel
+  OV5640_FRAME_YUV422     // YUYV, luma in the even bytes
+};
+
+/* A frame the metrics can read.  handle is whatever the source needs to
+ * give the buffer back (camera_fb_t* for the camera source). */
+struct OV5640_Frame {
+  const uint8_t* data;
+  uint16_t width;
+  uint16_t height;
+  uint16_t stride;        // bytes per row
+  OV5640_FrameFormat format;
+  void* handle;
+};
+
+/* Pixel rectangle inside a frame */
+struct OV5640_Rect {
+  uint16_t x, y, w, h;
+};
+
+enum OV5640_SharpMetric {
+  OV5640_SHARP_TENENGRAD,   // mean squared Sobel gradient
+  OV5640_SHARP_LAPLACIAN    // variance of the 4-neighbour Laplacian
+};
+
+class OV5640_Sharpness {
+public:
+  /**
+   * ROI from normalized coordinates (0..1), clipped to the frame interior
+   * so the 3x3 kernels never read outside the buffer.
+   */
+  static OV5640_Rect roi(const OV5640_Frame& f, float x, float y, float w, float h);
+  /** Tile (tx, ty) of a size x size grid, clipped the same way */
+  static OV5640_Rect tile(const OV5640_Frame& f, uint16_t size, uint16_t tx, uint16_t ty);
+
+  static uint32_t score(OV5640_SharpMetric m, const OV5640_Frame& f, const OV5640_Rect& r);
+
+  /* Row-pointer kernels specialised per pixel layout; the inner loops are
+   * branch free so the compiler can vectorise them. */
+  static uint32_t tenengrad(const OV5640_Frame& f, const OV5640_Rect& r);
+  static uint32_t laplacianVar(const OV5640_Frame& f, const OV5640_Rect& r);
+
+  /* Straightforward per-pixel reference versions, same results */
+  static uint32_t tenengradRef(const OV5640_Frame& f, const OV5640_Rect& r);
+  static uint32_t laplacianVarRef(const OV5640_Frame& f, const OV5640_Rect& r);
+};
+
+/* Where contrast AF gets its frames from */
+class OV5640_FrameSource {
+public:
+  typedef void (*ExposedFn)(void* ctx);
+
+  OV5640_FrameSource() : exposedFn(NULL), exposedCtx(NULL) {}
+  virtual ~OV5640_FrameSource() {}
+  virtual bool grab(OV5640_Frame& frame) = 0;
+  virtual void release(OV5640_Frame& frame) = 0;
+
+  /**
+   * Called from inside grab() once the frame has been exposed and only
+   * readout remains, so the lens may already move for the next one.
+   * Sources that cannot tell call it as soon as they have the frame,
+   * before handing it out.
+   */
+  void onExposed(ExposedFn fn, void* ctx) { exposedFn = fn; exposedCtx = ctx; }
+
+  /**
+   * Frames the source may still hand out that were exposed before now,
+   * while `held` of its frames are lent out: a driver's capture queue.
+   * Callers that move the lens drop that many before trusting a frame.
+   */
+  virtual uint8_t staleFrames(uint8_t held) const { (void)held; return 0; }
+
+protected:
+  void exposed() { if (exposedFn) exposedFn(exposedCtx); }
+
+private:
+  ExposedFn exposedFn;
+  void* exposedCtx;
+};
+
+#if defined(ARDUINO)
+/* esp_camera_fb_get() frames; needs PIXFORMAT_GRAYSCALE or PIXFORMAT_YUV422.
+ * fbCount is the fb_count the camera was initialised with.  The driver
+ * cannot say when exposure ends, so exposed() is only reported once the
+ * finished frame has arrived, and every buffer not lent out may hold a
+ * frame exposed before the last lens move. */
+class OV5640_CameraFrameSource : public OV5640_FrameSource {
+public:
+  OV5640_CameraFrameSource(uint8_t _fbCount = 1) : fbCount(_fbCount) {}
+  virtual bool grab(OV5640_Frame& frame);
+  virtual void release(OV5640_Frame& frame);
+  virtual uint8_t staleFrames(uint8_t held) const { return fbCount > held ? fbCount - held : 0; }
+
+private:
+  uint8_t fbCount;
+};
+#endif
+
+#endif
@@ -0,0 +1,439 @@
+/*
+  ESP32_OV5640_sim.cpp - OV5640 sensor / AF MCU simulator
+  Released into the public domain.
+*/
+
+#include <math.h>
+#include "ESP32_OV5640_sim.h"
+#include "ESP32_OV5640_cfg.h"
+
+#define SIM_TWO_PI                        6.283185307179586
+
+OV5640_Sim::OV5640_Sim() {
+  cfg = defaultConfig();
+  memset(&fake, 0, sizeof(fake));
+  fake.s.get_reg = fakeGetReg;
+  fake.s.set_reg = fakeSetReg;
+  fake.sim = this;
+  simUs = 0;
+  subjectStep = 512;
+  subjectFrom = subjectStep;
+  subjectVel = 0;
+  subjectAt = 0;
+  powerOn();
+}
+
+OV5640_SimConfig OV5640_Sim::defaultConfig() {
+  OV5640_SimConfig c;
+  c.busTxnUs = 120;
+  c.busByteUs = 90;
+  c.fwStartupUs = 5000;
+  c.fwIdleUs = 20000;
+  c.cmdUs = 1000;
+  c.lensUsPerStep = 10;
+  c.lensResonanceHz = 0;
+  c.lensDamping = 0.05f;
+  c.afSearchUs = 300000;
+  c.cafRescanUs = 2000000;
+  c.realTime = false;
+  return c;
+}
+
+void OV5640_Sim::powerOn() {
+  memset(afRegs, 0, sizeof(afRegs));
+  memset(fwRam, 0, sizeof(fwRam));
+  afRegs[OV5640_CHIPID_HIGH - 0x3000] = 0x56;
+  afRegs[OV5640_CHIPID_LOW - 0x3000] = 0x40;
+  afRegs[OV5640_MCU_RESET - 0x3000] = 0x20;
+  afRegs[OV5640_CMD_FW_STATUS - 0x3000] = FW_STATUS_S_FIRMWARE;
+  mcu = MCU_HELD;
+  mcuAt = 0;
+  cmdBusy = false;
+  cmd = 0;
+  cmdDoneAt = 0;
+  zones = pendingZones = 0;
+  lensFrom = lensTo = 0;
+  lensStart = lensEnd = simUs;
+  lensX = lensV = 0;
+  lensAtUs = simUs;
+  resetCounters();
+}
+
+void OV5640_Sim::resetCounters() {
+  transactions = 0;
+  pollReads = 0;
+  commands = 0;
+  afSearches = 0;
+}
+
+/********************  time  ********************/
+
+uint32_t OV5640_Sim::nowUs() {
+  return (uint32_t)simUs;
+}
+
+void OV5640_Sim::sleepMs(uint32_t ms) {
+  advanceUs(ms * 1000);
+}
+
+void OV5640_Sim::advanceUs(uint32_t us) {
+  simUs += us;
+  if (cfg.realTime) {
+#if defined(ARDUINO)
+    delayMicroseconds(us);
+#else
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+#endif
+  }
+  update();
+}
+
+void OV5640_Sim::busTime(uint32_t txns, uint32_t bytes) {
+  transactions += txns;
+  advanceUs(txns * cfg.busTxnUs + bytes * cfg.busByteUs);
+}
+
+/********************  bus  ********************/
+
+int OV5640_Sim::busWrite(uint16_t reg, uint8_t val) {
+  busTime(1, 3);
+  store(reg, val);
+  return 0;
+}
+
+int OV5640_Sim::busWriteBurst(uint16_t reg, const uint8_t* data, size_t len) {
+  busTime(1, 2 + len);
+  for (size_t i = 0; i < len; i++)
+    store(reg + i, data[i]);
+  return 0;
+}
+
+int OV5640_Sim::busRead(uint16_t reg) {
+  busTime(2, 3);
+  if (reg == OV5640_CMD_ACK || reg == OV5640_CMD_FW_STATUS)
+    pollReads++;
+  return peek(reg);
+}
+
+uint8_t OV5640_Sim::peek(uint16_t reg) const {
+  if (reg >= 0x3000 && reg < 0x3100) return afRegs[reg - 0x3000];
+  if (reg >= OV5640_FW_BASE && reg < OV5640_FW_BASE + OV5640_SIM_FW_SIZE)
+    return fwRam[reg - OV5640_FW_BASE];
+  return 0;
+}
+
+void OV5640_Sim::store(uint16_t reg, uint8_t val) {
+  if (reg >= OV5640_FW_BASE && reg < OV5640_FW_BASE + OV5640_SIM_FW_SIZE) {
+    fwRam[reg - OV5640_FW_BASE] = val;
+    return;
+  }
+  if (reg < 0x3000 || reg >= 0x3100) return;
+  afRegs[reg - 0x3000] = val;
+
+  if (reg == OV5640_MCU_RESET) {
+    if (val & 0x20) {
+      mcu = MCU_HELD;
+      cmdBusy = false;
+    } else if (mcu == MCU_HELD) {
+      /* The MCU only comes up if the full image is in RAM */
+      if (memcmp(fwRam, OV5640_AF_Config, sizeof(OV5640_AF_Config)) == 0) {
+        mcu = MCU_STARTUP;
+        mcuAt = simUs + cfg.fwStartupUs;
+      } else {
+        mcu = MCU_DEAD;
+      }
+    }
+  } else if (reg == OV5640_CMD_MAIN && mcu == MCU_RUN) {
+    startCommand(val);
+  }
+}
+
+/********************  AF MCU model  ********************/
+
+void OV5640_Sim::startCommand(uint8_t _cmd) {
+  uint32_t busyUs = cfg.cmdUs;
+  uint16_t target;
+
+  commands++;
+  cmd = _cmd;
+  switch (cmd) {
+    case AF_TRIG_SINGLE_AUTO_FOCUS:
+    case AF_CONTINUE_AUTO_FOCUS:
+      startSearch();
+      if (cmd == AF_TRIG_SINGLE_AUTO_FOCUS) busyUs += cfg.afSearchUs;
+      break;
+    case AF_MOVE_LENS:
+      target = ((afRegs[OV5640_CMD_PARA3 - 0x3000] << 8) |
+                afRegs[OV5640_CMD_PARA4 - 0x3000]) & 0x03FF;
+      moveLens(target);
+      busyUs += lensEnd - lensStart;
+      break;
+    case AF_RELEASE_FOCUS:
+      afRegs[OV5640_CMD_FW_STATUS - 0x3000] = FW_STATUS_S_IDLE;
+      break;
+    case AF_SET_TOUCH_ZONE:
+      pendingZones = 1;
+      afRegs[OV5640_CMD_FW_STATUS - 0x3000] = FW_STATUS_S_ZONE_CONFIG;
+      break;
+    case AF_CUSTOM_ZONES:
+      pendingZones = 0;
+      afRegs[OV5640_CMD_FW_STATUS - 0x3000] = FW_STATUS_S_ZONE_CONFIG;
+      break;
+    case AF_DEFAULT_ZONES:
+      pendingZones = 0;
+      break;
+    case AF_LAUNCH_ZONES:
+      zones = pendingZones;
+      afRegs[OV5640_CMD_FW_STATUS - 0x3000] = FW_STATUS_S_IDLE;
+      break;
+    default:
+      if (cmd >= AF_SET_ZONE_BASE && cmd < AF_SET_ZONE_BASE + AF_MAX_ZONES) {
+        if (cmd - AF_SET_ZONE_BASE + 1 > pendingZones) pendingZones = cmd - AF_SET_ZONE_BASE + 1;
+        afRegs[OV5640_CMD_FW_STATUS - 0x3000] = FW_STATUS_S_ZONE_CONFIG;
+      }
+      break;
+  }
+  cmdBusy = true;
+  cmdDoneAt = simUs + busyUs;
+}
+
+void OV5640_Sim::setSubjectStep(uint16_t step) {
+  subjectStep = step;
+  subjectFrom = step;
+  subjectAt = simUs;
+}
+
+void OV5640_Sim::setSubjectVelocity(float stepsPerSec) {
+  subjectFrom = subjectStep;
+  subjectAt = simUs;
+  subjectVel = stepsPerSec;
+}
+
+void OV5640_Sim::startSearch() {
+  afRegs[OV5640_CMD_FW_STATUS - 0x3000] = FW_STATUS_S_FOCUSING;
+  moveLens(subjectStep);
+  lensEnd = simUs + cfg.afSearchUs;     // search, not a straight move
+  afSearches++;
+}
+
+void OV5640_Sim::moveLens(uint16_t target) {
+  /* the driver slews from its own output, whatever the lens mass does */
+  uint16_t pos;
+  if (cfg.lensResonanceHz > 0) {
+    integrateLens();                    // up to now under the old slew
+    pos = (uint16_t)(driveAt(simUs) + 0.5f);
+  } else {
+    pos = lensPosition();
+  }
+  lensFrom = pos;
+  lensTo = target;
+  lensStart = simUs;
+  lensEnd = simUs + (uint64_t)(pos > target ? pos - target : target - pos) * cfg.lensUsPerStep;
+}
+
+uint16_t OV5640_Sim::lensPosition() {
+  if (cfg.lensResonanceHz > 0) {
+    integrateLens();
+    return lensX < 0 ? 0 : (lensX > 1023 ? 1023 : (uint16_t)(lensX + 0.5));   // end stops
+  }
+  if (simUs >= lensEnd || lensEnd == lensStart) return lensTo;
+  int32_t span = (int32_t)lensTo - lensFrom;
+  return lensFrom + (int32_t)(span * (int64_t)(simUs - lensStart) / (int64_t)(lensEnd - lensStart));
+}
+
+/* Driver output at time t: a straight slew from lensFrom to lensTo */
+float OV5640_Sim::driveAt(uint64_t t) const {
+  if (t >= lensEnd || lensEnd == lensStart) return lensTo;
+  if (t <= lensStart) return lensFrom;
+  return lensFrom + ((float)lensTo - lensFrom) * (float)(t - lensStart) / (float)(lensEnd - lensStart);
+}
+
+/*
+ * The lens is a damped mass on the VCM spring, pulled toward the driver
+ * output u:  x'' = w^2 (u - x) - 2 zeta w x'.  Semi-implicit Euler in
+ * OV5640_SIM_LENS_DT_US steps; once the drive has stopped and the lens
+ * has come to rest it jumps to the current time.
+ */
+void OV5640_Sim::integrateLens() {
+  double w = SIM_TWO_PI * cfg.lensResonanceHz / 1e6;   // rad/us
+  double zw2 = 2 * cfg.lensDamping * w;
+  while (lensAtUs < simUs) {
+    uint64_t t = lensAtUs + OV5640_SIM_LENS_DT_US;
+    if (t > simUs) t = simUs;
+    double dt = (double)(t - lensAtUs);
+    double u = driveAt(t);
+    lensV += (w * w * (u - lensX) - zw2 * lensV) * dt;
+    lensX += lensV * dt;
+    lensAtUs = t;
+    if (t >= lensEnd && fabs(u - lensX) < 1e-3 && fabs(lensV) < 1e-6) {
+      lensX = u;
+      lensV = 0;
+      lensAtUs = simUs;
+    }
+  }
+}
+
+bool OV5640_Sim::lensMoving() {
+  return simUs < lensEnd;
+}
+
+void OV5640_Sim::update() {
+  uint8_t* status = &afRegs[OV5640_CMD_FW_STATUS - 0x3000];
+
+  if (cfg.lensResonanceHz > 0) integrateLens();
+
+  if (subjectVel != 0) {
+    float s = subjectFrom + subjectVel * (float)(simUs - subjectAt) / 1e6f;
+    subjectStep = s < 0 ? 0 : (s > 1023 ? 1023 : (uint16_t)(s + 0.5f));
+  }
+
+  if (mcu == MCU_STARTUP && simUs >= mcuAt) {
+    *status = FW_STATUS_S_STARTUP;
+    mcu = MCU_BOOT;
+    mcuAt += cfg.fwIdleUs;
+  }
+  if (mcu == MCU_BOOT && simUs >= mcuAt) {
+    *status = FW_STATUS_S_IDLE;
+    mcu = MCU_RUN;
+  }
+  if (mcu != MCU_RUN) return;
+
+  if ((cmd == AF_TRIG_SINGLE_AUTO_FOCUS || cmd == AF_CONTINUE_AUTO_FOCUS) &&
+      *status == FW_STATUS_S_FOCUSING && simUs >= lensEnd) {
+    *status = FW_STATUS_S_FOCUSED;
+    /* every configured zone (the centre one by default) reports in focus */
+    for (uint8_t i = 0; i < AF_MAX_ZONES; i++)
+      afRegs[OV5640_CMD_PARA0 - 0x3000 + i] = i < (zones ? zones : 1) ? 1 : 0;
+  }
+
+  /* Continuous AF searches again when the subject moves, and every so
+   * often on a static scene too (hunting) */
+  if (cmd == AF_CONTINUE_AUTO_FOCUS && *status == FW_STATUS_S_FOCUSED &&
+      (lensTo != subjectStep || (cfg.cafRescanUs && simUs >= lensEnd + cfg.cafRescanUs)))
+    startSearch();
+
+  if (cmdBusy && simUs >= cmdDoneAt) {
+    afRegs[OV5640_CMD_ACK - 0x3000] = 0x00;
+    cmdBusy = false;
+  }
+}
+
+/********************  fake sensor_t  ********************/
+
+int OV5640_Sim::fakeGetReg(sensor_t* s, int reg, int mask) {
+  OV5640_Sim* sim = reinterpret_cast<FakeSensor*>(s)->sim;
+  int val = sim->busRead(reg);
+  return val < 0 ? val : (val & mask);
+}
+
+int OV5640_Sim::fakeSetReg(sensor_t* s, int reg, int mask, int value) {
+  OV5640_Sim* sim = reinterpret_cast<FakeSensor*>(s)->sim;
+  if (mask != 0xff) {
+    int old = sim->peek(reg);
+    value = (old & ~mask) | (value & mask);
+  }
+  return sim->busWrite(reg, value);
+}
+
+/********************  synthetic frames  ********************/
+
+OV5640_SimFrameSource::OV5640_SimFrameSource(OV5640_Sim& _sim, uint8_t* _buf,
+                                             uint16_t _width, uint16_t _height,
+                                             OV5640_FrameFormat _format, uint8_t _buffers)
+  : sim(_sim), buf(_buf), format(_format) {
+  width = _width > OV5640_SIM_MAX_DIM ? OV5640_SIM_MAX_DIM : _width;
+  height = _height > OV5640_SIM_MAX_DIM ? OV5640_SIM_MAX_DIM : _height;
+  buffers = _buffers ? _buffers : 1;
+  next = 0;
+  cur = buf;
+  scene = defaultScene();
+  framesRendered = 0;
+}
+
+OV5640_SimSceneConfig OV5640_SimFrameSource::defaultScene() {
+  OV5640_SimSceneConfig c;
+  c.cell = 8;
+  c.contrast = 160;
+  c.noise = 4;
+  c.blurPerStep = 0.08f;
+  c.frameUs = 33333;
+  c.depthSteps = 0;
+  return c;
+}
+
+/* Box-blurred square wave, +/-256 at full contrast, for out[x0..x1).
+ * The checkerboard is the product of a row and a column wave, so
+ * blurring each axis blurs it. */
+void OV5640_SimFrameSource::blurAxis(int16_t* out, uint16_t x0, uint16_t x1, uint16_t radius) {
+  uint16_t cell = scene.cell ? scene.cell : 1;
+  for (int x = x0; x < x1; x++) {
+    int32_t acc = 0;
+    for (int k = x - radius; k <= x + radius; k++)
+      acc += ((k + 4096 * cell) / cell) & 1 ? 256 : -256;
+    out[x] = acc / (2 * radius + 1);
+  }
+}
+
+/* Columns x0..x1 of the frame, all at the same defocus */
+void OV5640_SimFrameSource::renderBand(uint16_t x0, uint16_t x1, uint16_t defocus) {
+  uint16_t radius = (uint16_t)(defocus * scene.blurPerStep + 0.5f);
+  uint8_t px = format == OV5640_FRAME_YUV422 ? 2 : 1;
+  uint32_t frameSeed = framesRendered * 2654435761u;
+
+  blurAxis(colWave, x0, x1, radius);
+  blurAxis(rowWave, 0, height, radius);
+  for (uint16_t y = 0; y < height; y++) {
+    uint8_t* row = cur + (uint32_t)y * width * px;
+    for (uint16_t x = x0; x < x1; x++) {
+      int32_t v = 128 + (int32_t)scene.contrast * colWave[x] * rowWave[y] / (2 * 65536);
+      if (scene.noise) {
+        uint32_t seed = (frameSeed ^ ((uint32_t)y * width + x)) * 1664525u + 1013904223u;
+        seed ^= seed >> 15;
+        seed *= 2246822519u;
+        v += (int32_t)((seed >> 24) % (2 * scene.noise + 1)) - scene.noise;
+      }
+      row[x * px] = v < 0 ? 0 : (v > 255 ? 255 : v);
+      if (px == 2) row[x * 2 + 1] = 128;
+    }
+  }
+}
+
+void OV5640_SimFrameSource::render(uint16_t defocus) {
+  renderBand(0, width, defocus);
+  framesRendered++;
+}
+
+uint16_t OV5640_SimFrameSource::subjectAt(uint16_t x) const {
+  int32_t s = sim.getSubjectStep() +
+              (int32_t)scene.depthSteps * ((int32_t)2 * x + 1 - width) / (2 * width);
+  return s < 0 ? 0 : (s > 1023 ? 1023 : s);
+}
+
+void OV5640_SimFrameSource::renderLens(uint16_t lens) {
+  uint16_t band = scene.depthSteps ? OV5640_SIM_DEPTH_BAND : width;
+  for (uint16_t x0 = 0; x0 < width; x0 += band) {
+    uint16_t x1 = x0 + band < width ? x0 + band : width;
+    uint16_t subject = subjectAt((x0 + x1) / 2);
+    renderBand(x0, x1, lens > subject ? lens - subject : subject - lens);
+  }
+  framesRendered++;
+}
+
+bool OV5640_SimFrameSource::grab(OV5640_Frame& frame) {
+  uint16_t stride = width * (format == OV5640_FRAME_YUV422 ? 2 : 1);
+  cur = buf + (uint32_t)next * stride * height;
+  next = (next + 1) % buffers;
+
+  /* Exposure happens at the start of the frame period; use the lens there */
+  renderLens(sim.lensPosition());
+  exposed();
+  sim.advanceUs(scene.frameUs);
+
+  frame.data = cur;
+  frame.width = width;
+  frame.height = height;
+  frame.stride = stride;
+  frame.format = format;
+  frame.handle = NULL;
+  return true;
+}
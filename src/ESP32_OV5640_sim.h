@@ -0,0 +1,198 @@
+/*
+  ESP32_OV5640_sim.h - OV5640 sensor / AF MCU simulator
+  Released into the public domain.
+
+  A behavioural model of the parts of the OV5640 the AF library talks to:
+  chip ID, the AF command block (0x3022-0x3029), firmware RAM at 0x8000
+  and the VCM lens.  Runs on virtual time so it works on a Linux host as
+  well as on an ESP32 without a camera attached.
+*/
+
+#ifndef ESP32_OV5640_sim_h
+#define ESP32_OV5640_sim_h
+
+#include "ESP32_OV5640_port.h"
+#include "ESP32_OV5640_transport.h"
+#include "ESP32_OV5640_sharpness.h"
+
+#define OV5640_SIM_FW_SIZE                0x1000
+#define OV5640_SIM_MAX_DIM                640
+#define OV5640_SIM_DEPTH_BAND             16     // columns per depth plane
+#define OV5640_SIM_LENS_DT_US             10     // integration step of the lens resonance
+
+struct OV5640_SimConfig {
+  uint32_t busTxnUs;      // START + device address + STOP, per transaction
+  uint32_t busByteUs;     // per byte after the device address
+  uint32_t fwStartupUs;   // MCU release -> status 0x7E
+  uint32_t fwIdleUs;      // 0x7E -> 0x70
+  uint32_t cmdUs;         // command decode until ACK clears
+  uint32_t lensUsPerStep; // VCM travel time per step
+  float lensResonanceHz;  // lens mass on the VCM spring, 0 = follows the drive exactly
+  float lensDamping;      // damping ratio of that resonance
+  uint32_t afSearchUs;    // contrast search for single/continuous AF
+  uint32_t cafRescanUs;   // continuous AF re-search on a static scene, 0 = never
+  bool realTime;          // also sleep for real, so wall time follows
+};
+
+class OV5640_Sim : public OV5640_Clock {
+public:
+  OV5640_Sim();
+
+  /** Defaults approximate a 100 kHz SCCB bus and a typical AF module */
+  static OV5640_SimConfig defaultConfig();
+  void configure(const OV5640_SimConfig& _cfg) { cfg = _cfg; }
+  const OV5640_SimConfig& config() const { return cfg; }
+
+  /** Power-on state: firmware RAM cleared, MCU status 0x7F */
+  void powerOn();
+
+  /* Bus side, each call is one transaction on the simulated bus */
+  int busWrite(uint16_t reg, uint8_t val);
+  int busWriteBurst(uint16_t reg, const uint8_t* data, size_t len);
+  int busRead(uint16_t reg);
+
+  /** Fake esp32-camera sensor_t whose set_reg/get_reg land here */
+  sensor_t* sensor() { return &fake.s; }
+
+  /* OV5640_Clock on virtual time */
+  virtual uint32_t nowUs();
+  virtual void sleepMs(uint32_t ms);
+  virtual void sleepUs(uint32_t us) { advanceUs(us); }
+  void advanceUs(uint32_t us);
+
+  /** Lens step the built-in AF converges on */
+  void setSubjectStep(uint16_t step);
+  uint16_t getSubjectStep() const { return subjectStep; }
+  /** Moving subject: the step drifts from where it is now, clamped to 0..1023 */
+  void setSubjectVelocity(float stepsPerSec);
+  /** Where the lens mass is, ringing included */
+  uint16_t lensPosition();
+  uint16_t lensTarget() const { return lensTo; }
+  bool lensMoving();
+  uint8_t peek(uint16_t reg) const;
+
+  /* Counters since resetCounters() */
+  uint32_t transactions;
+  uint32_t pollReads;     // reads of CMD_ACK / FW_STATUS
+  uint32_t commands;      // CMD_MAIN writes accepted by the MCU
+  uint32_t afSearches;    // contrast searches run by the firmware
+  void resetCounters();
+
+private:
+  struct FakeSensor {
+    sensor_t s;           // must stay first
+    OV5640_Sim* sim;
+  };
+  static int fakeGetReg(sensor_t* s, int reg, int mask);
+  static int fakeSetReg(sensor_t* s, int reg, int mask, int value);
+
+  void busTime(uint32_t txns, uint32_t bytes);
+  void update();
+  void store(uint16_t reg, uint8_t val);
+  void startCommand(uint8_t cmd);
+  void startSearch();
+  void moveLens(uint16_t target);
+  float driveAt(uint64_t t) const;
+  void integrateLens();
+
+  OV5640_SimConfig cfg;
+  FakeSensor fake;
+
+  uint8_t afRegs[0x100];          // 0x3000..0x30FF
+  uint8_t fwRam[OV5640_SIM_FW_SIZE];
+  uint64_t simUs;
+
+  enum { MCU_HELD, MCU_STARTUP, MCU_BOOT, MCU_RUN, MCU_DEAD } mcu;
+  uint64_t mcuAt;                 // time of the next status transition
+
+  bool cmdBusy;
+  uint8_t cmd;
+  uint64_t cmdDoneAt;
+
+  uint8_t zones;                  // zones launched, 0 = firmware default
+  uint8_t pendingZones;
+  uint16_t subjectStep;
+  float subjectFrom, subjectVel;  // motion since subjectAt
+  uint64_t subjectAt;
+  uint16_t lensFrom, lensTo;      // the driver slews its output linearly
+  uint64_t lensStart, lensEnd;
+  double lensX, lensV;            // lens mass: position, steps/us
+  uint64_t lensAtUs;              // integrated up to
+};
+
+/* Transport straight into the simulator, with sequential writes */
+class OV5640_SimTransport : public OV5640_Transport {
+public:
+  OV5640_SimTransport(OV5640_Sim& _sim, size_t _burst = OV5640_BURST_DEFAULT)
+    : sim(_sim), burst(_burst) {}
+  virtual size_t maxBurst() const { return burst; }
+
+protected:
+  virtual int writeReg(uint16_t reg, uint8_t val) { return sim.busWrite(reg, val); }
+  virtual int readReg(uint16_t reg) { return sim.busRead(reg); }
+  virtual int writeBurst(uint16_t reg, const uint8_t* data, size_t len) {
+    return sim.busWriteBurst(reg, data, len);
+  }
+
+private:
+  OV5640_Sim& sim;
+  size_t burst;
+};
+
+/* Synthetic scene: a checkerboard blurred in proportion to the defocus.
+ * With depthSteps set the target is tilted: the subject step of each band
+ * of OV5640_SIM_DEPTH_BAND columns runs linearly across the frame,
+ * centred on the simulator's subject step. */
+struct OV5640_SimSceneConfig {
+  uint16_t cell;          // checker cell size in pixels
+  uint8_t contrast;       // peak-to-peak amplitude of the pattern
+  uint8_t noise;          // +/- sensor noise, not affected by focus
+  float blurPerStep;      // box blur radius per lens step of defocus
+  uint32_t frameUs;       // frame period; each grab advances sim time
+  int16_t depthSteps;     // tilted target: subject step change left to right
+};
+
+/**
+ * Frame source rendering what the simulated lens would see.  The caller
+ * provides the frame buffers: width * height bytes each (twice that for
+ * YUV422), width and height at most OV5640_SIM_MAX_DIM.  Frames rotate
+ * through the buffers like a camera frame buffer queue, so up to
+ * `buffers` frames can be held at once.  Exposure happens at the start of
+ * each frame period, the rest is readout.
+ */
+class OV5640_SimFrameSource : public OV5640_FrameSource {
+public:
+  OV5640_SimFrameSource(OV5640_Sim& _sim, uint8_t* _buf, uint16_t _width, uint16_t _height,
+                        OV5640_FrameFormat _format = OV5640_FRAME_GRAY, uint8_t _buffers = 1);
+
+  static OV5640_SimSceneConfig defaultScene();
+  void setScene(const OV5640_SimSceneConfig& _scene) { scene = _scene; }
+  const OV5640_SimSceneConfig& getScene() const { return scene; }
+
+  /** Render a frame at an explicit defocus, without touching sim time */
+  void render(uint16_t defocus);
+  /** Lens step in focus at column x */
+  uint16_t subjectAt(uint16_t x) const;
+
+  virtual bool grab(OV5640_Frame& frame);
+  virtual void release(OV5640_Frame& frame) { frame.data = NULL; }
+
+  uint32_t framesRendered;
+
+private:
+  void blurAxis(int16_t* out, uint16_t x0, uint16_t x1, uint16_t radius);
+  void renderBand(uint16_t x0, uint16_t x1, uint16_t defocus);
+  void renderLens(uint16_t lens);
+
+  OV5640_Sim& sim;
+  OV5640_SimSceneConfig scene;
+  uint8_t* buf;
+  uint8_t* cur;           // buffer the next render goes to
+  uint8_t buffers, next;
+  uint16_t width, height;
+  OV5640_FrameFormat format;
+  int16_t colWave[OV5640_SIM_MAX_DIM];
+  int16_t rowWave[OV5640_SIM_MAX_DIM];
+};
+
+#endif
@@ -0,0 +1,109 @@
+/*
+  ESP32_OV5640_softaf.cpp - Software contrast-detection autofocus
+  Released into the public domain.
+*/
+
+#include "ESP32_OV5640_softaf.h"
+
+OV5640_SoftAF::OV5640_SoftAF(OV5640& _cam, OV5640_FrameSource& _source)
+  : cam(_cam), source(_source) {
+  cfg = defaultConfig();
+  memset(&res, 0, sizeof(res));
+  scoredUs = 0;
+}
+
+OV5640_SoftAFConfig OV5640_SoftAF::defaultConfig() {
+  OV5640_SoftAFConfig c;
+  c.metric = OV5640_SHARP_TENENGRAD;
+  c.roiX = 0.25f;
+  c.roiY = 0.25f;
+  c.roiW = 0.5f;
+  c.roiH = 0.5f;
+  c.minStep = 0;
+  c.maxStep = 1023;
+  c.coarseStep = 64;
+  c.fineStep = 4;
+  c.settleFrames = 1;
+  c.dropPercent = 20;
+  return c;
+}
+
+uint8_t OV5640_SoftAF::measure(uint16_t step, uint32_t& score, uint32_t* atUs) {
+  OV5640_Frame frame;
+  uint8_t rc = cam.manualFocus(step);
+  if (rc) return rc;
+
+  res.stepsTried++;
+  for (uint8_t i = 0; i <= cfg.settleFrames; i++) {
+    if (!source.grab(frame)) return OV5640_SOFTAF_NO_FRAME;
+    res.frames++;
+    if (i == cfg.settleFrames) {
+      scoredUs = cam.getClock()->nowUs();
+      if (atUs) *atUs = scoredUs;
+      OV5640_Rect r = OV5640_Sharpness::roi(frame, cfg.roiX, cfg.roiY, cfg.roiW, cfg.roiH);
+      score = OV5640_Sharpness::score(cfg.metric, frame, r);
+    }
+    source.release(frame);
+  }
+  return 0;
+}
+
+/* Measure step and keep it if it beats the best so far; false on error */
+bool OV5640_SoftAF::tryStep(uint16_t step, uint16_t& best, uint32_t& bestScore, uint32_t& score) {
+  score = 0;
+  res.rc = measure(step, score);
+  if (res.rc) return false;
+  if (score > bestScore) {
+    best = step;
+    bestScore = score;
+    res.atUs = scoredUs;
+  }
+  return true;
+}
+
+uint8_t OV5640_SoftAF::run(OV5640_SoftAFResult* result) {
+  return run(cfg.minStep, cfg.maxStep, result);
+}
+
+uint8_t OV5640_SoftAF::run(uint16_t lo, uint16_t hi, OV5640_SoftAFResult* result) {
+  OV5640_Clock* clock = cam.getClock();
+  uint32_t start = clock->nowUs();
+  uint16_t best = lo, spacing = cfg.coarseStep ? cfg.coarseStep : 1;
+  uint32_t bestScore = 0, score;
+  uint8_t below = 0;
+
+  memset(&res, 0, sizeof(res));
+  if (hi > 1023) hi = 1023;
+  if (lo > hi) lo = hi;
+
+  /* Coarse climb from lo; stop once two samples sit clearly past the peak */
+  for (uint16_t s = lo; ; s += spacing) {
+    if (s > hi) s = hi;
+    if (!tryStep(s, best, bestScore, score)) goto done;
+    if (best == s)
+      below = 0;
+    else if ((uint64_t)score * 100 < (uint64_t)bestScore * (100 - cfg.dropPercent) && ++below >= 2)
+      break;
+    if (s == hi) break;
+  }
+
+  /* Refine: halve the spacing and test both neighbours of the best step */
+  while (spacing > cfg.fineStep) {
+    spacing /= 2;
+    if (spacing < cfg.fineStep) spacing = cfg.fineStep;
+    if (spacing == 0) break;
+    uint16_t centre = best;
+    if (centre >= lo + spacing && !tryStep(centre - spacing, best, bestScore, score)) goto done;
+    if (centre + spacing <= hi && !tryStep(centre + spacing, best, bestScore, score)) goto done;
+  }
+
+  res.rc = cam.manualFocus(best);
+
+done:
+  if (!bestScore) res.atUs = clock->nowUs();
+  res.step = best;
+  res.score = bestScore;
+  res.timeUs = clock->nowUs() - start;
+  if (result) *result = res;
+  return res.rc;
+}
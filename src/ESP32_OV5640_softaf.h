@@ -0,0 +1,72 @@
+/*
+  ESP32_OV5640_softaf.h - Software contrast-detection autofocus
+  Released into the public domain.
+
+  Hill climb over manualFocus() steps scored by a sharpness metric on the
+  frames the sensor delivers: a coarse scan that stops once the score has
+  clearly passed its peak, then halving refinement around the best step.
+*/
+
+#ifndef ESP32_OV5640_softaf_h
+#define ESP32_OV5640_softaf_h
+
+#include "ESP32_OV5640_AF.h"
+#include "ESP32_OV5640_sharpness.h"
+
+#define OV5640_SOFTAF_NO_FRAME            (OV5640_RC_SOFTAF + 0)
+
+struct OV5640_SoftAFConfig {
+  OV5640_SharpMetric metric;
+  float roiX, roiY, roiW, roiH;   // normalized ROI
+  uint16_t minStep, maxStep;      // search range
+  uint16_t coarseStep;            // spacing of the first scan
+  uint16_t fineStep;              // refine until spacing reaches this
+  uint8_t settleFrames;           // frames dropped after each lens move
+  uint8_t dropPercent;            // scan stops 2 samples this far below peak
+};
+
+struct OV5640_SoftAFResult {
+  uint8_t rc;
+  uint16_t step;          // locked lens step
+  uint32_t score;         // sharpness there
+  uint32_t atUs;          // when the frame scored at step was grabbed
+  uint16_t stepsTried;    // lens positions measured
+  uint16_t frames;        // frames consumed, including settle frames
+  uint32_t timeUs;        // time to lock
+};
+
+class OV5640_SoftAF {
+public:
+  OV5640_SoftAF(OV5640& _cam, OV5640_FrameSource& _source);
+
+  /** Tenengrad over the centre quarter, 64-step scan refined to 4 steps */
+  static OV5640_SoftAFConfig defaultConfig();
+  void configure(const OV5640_SoftAFConfig& _cfg) { cfg = _cfg; }
+  const OV5640_SoftAFConfig& config() const { return cfg; }
+
+  /**
+   * Search the configured range and leave the lens at the sharpest step.
+   * @returns OV5640_OK, a manualFocus() error, or OV5640_SOFTAF_NO_FRAME
+   */
+  uint8_t run(OV5640_SoftAFResult* result = NULL);
+  /** Same, restricted to [lo, hi] */
+  uint8_t run(uint16_t lo, uint16_t hi, OV5640_SoftAFResult* result = NULL);
+
+  /** Move to step, drop settle frames and score the next frame; atUs, if
+   *  given, receives when that frame was grabbed */
+  uint8_t measure(uint16_t step, uint32_t& score, uint32_t* atUs = NULL);
+
+  const OV5640_SoftAFResult& lastResult() const { return res; }
+  OV5640& camera() { return cam; }
+
+private:
+  bool tryStep(uint16_t step, uint16_t& best, uint32_t& bestScore, uint32_t& score);
+
+  OV5640& cam;
+  OV5640_FrameSource& source;
+  OV5640_SoftAFConfig cfg;
+  OV5640_SoftAFResult res;
+  uint32_t scoredUs;      // grab time of the frame measure() scored last
+};
+
+#endif
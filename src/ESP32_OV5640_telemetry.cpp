@@ -0,0 +1,80 @@
+/*
+  ESP32_OV5640_telemetry.cpp - AF event telemetry
+  Released into the public domain.
+*/
+
+#include "ESP32_OV5640_telemetry.h"
+
+/* Index of each OV5640_TelemetryCounters field in n[] */
+enum {
+  C_EVENTS, C_DROPPED, C_OPS, C_FAILURES, C_COMMANDS, C_ACKS, C_ACK_US,
+  C_STATUS, C_LENS, C_BUS, C_TIMEOUTS, C_COUNT
+};
+
+static_assert(C_COUNT * sizeof(uint32_t) == sizeof(OV5640_TelemetryCounters),
+              "counter index out of step with OV5640_TelemetryCounters");
+
+OV5640_Telemetry::OV5640_Telemetry() : producer(NULL) {
+  resetCounters();
+}
+
+bool OV5640_Telemetry::attach(const void* owner) {
+  const void* expected = NULL;
+  return producer.compare_exchange_strong(expected, owner) || expected == owner;
+}
+
+void OV5640_Telemetry::detach(const void* owner) {
+  const void* expected = owner;
+  producer.compare_exchange_strong(expected, NULL);
+}
+
+void OV5640_Telemetry::resetCounters() {
+  for (uint8_t i = 0; i < C_COUNT; i++) n[i].store(0, std::memory_order_relaxed);
+}
+
+void OV5640_Telemetry::record(uint8_t type, uint16_t arg, uint32_t value, uint32_t us) {
+  /* one writer: plain load + store, no read-modify-write needed */
+  #define BUMP(i, v) n[i].store(n[i].load(std::memory_order_relaxed) + (v), std::memory_order_relaxed)
+
+  BUMP(C_EVENTS, 1);
+  switch (type) {
+    case OV5640_EVT_OP_START: BUMP(C_OPS, 1);                        break;
+    case OV5640_EVT_OP_DONE:  if (arg & 0xff) BUMP(C_FAILURES, 1);   break;
+    case OV5640_EVT_COMMAND:  BUMP(C_COMMANDS, 1);                   break;
+    case OV5640_EVT_ACK:      BUMP(C_ACKS, 1); BUMP(C_ACK_US, value); break;
+    case OV5640_EVT_STATUS:   BUMP(C_STATUS, 1);                     break;
+    case OV5640_EVT_LENS:     BUMP(C_LENS, 1);                       break;
+    case OV5640_EVT_BUS:      BUMP(C_BUS, value);                    break;
+    case OV5640_EVT_TIMEOUT:  BUMP(C_TIMEOUTS, 1);                   break;
+  }
+
+  OV5640_Event e;
+  e.us = us;
+  e.value = value;
+  e.arg = arg;
+  e.type = type;
+  if (!ring.push(e)) BUMP(C_DROPPED, 1);
+
+  #undef BUMP
+}
+
+uint32_t OV5640_Telemetry::read(OV5640_Event* out, uint32_t max) {
+  uint32_t got = 0;
+  while (got < max && ring.pop(out[got])) got++;
+  return got;
+}
+
+OV5640_TelemetryCounters OV5640_Telemetry::counters() const {
+  uint32_t v[C_COUNT];
+  for (uint8_t i = 0; i < C_COUNT; i++) v[i] = n[i].load(std::memory_order_relaxed);
+  OV5640_TelemetryCounters c;
+  memcpy(&c, v, sizeof(c));
+  return c;
+}
+
+const char* OV5640_Telemetry::eventName(uint8_t type) {
+  static const char* const names[OV5640_EVT_COUNT] = {
+    "op start", "op done", "command", "ack", "status", "lens", "bus", "timeout"
+  };
+  return type < OV5640_EVT_COUNT ? names[type] : "?";
+}
@@ -0,0 +1,138 @@
+/*
+  ESP32_OV5640_telemetry.h - AF event telemetry
+  Released into the public domain.
+
+  With OV5640_TELEMETRY defined to 1 for the whole build (library
+  included, e.g. -DOV5640_TELEMETRY=1 in build_flags), OV5640 records
+  timestamped events into an OV5640_Telemetry attached with
+  setTelemetry(): operations starting and finishing, AF commands, ACKs
+  clearing, firmware status changes, lens moves, bus transactions per
+  operation and timeouts.  Without it the hooks compile to nothing.
+
+  The events go through a single-producer / single-consumer ring: the AF
+  path (whatever calls poll()) is the producer, one other task may drain
+  it with read().  Neither side blocks or allocates; a full ring drops
+  the new event and counts it.  Aggregate counters are kept whether or
+  not anybody drains the ring.
+*/
+
+#ifndef ESP32_OV5640_telemetry_h
+#define ESP32_OV5640_telemetry_h
+
+#include <atomic>
+#include "ESP32_OV5640_port.h"
+
+#ifndef OV5640_TELEMETRY
+#define OV5640_TELEMETRY                  0
+#endif
+
+#define OV5640_TELEMETRY_RING             128    // events, a power of two
+
+enum OV5640_EventType {
+  OV5640_EVT_OP_START,      // arg = op type
+  OV5640_EVT_OP_DONE,       // arg = op type << 8 | result, value = duration us
+  OV5640_EVT_COMMAND,       // arg = command written to CMD_MAIN
+  OV5640_EVT_ACK,           // ACK cleared: arg = status reads, value = wait us
+  OV5640_EVT_STATUS,        // FW_STATUS changed: arg = old << 8 | new
+  OV5640_EVT_LENS,          // manual move done: arg = step
+  OV5640_EVT_BUS,           // arg = op type, value = bus transactions of the op
+  OV5640_EVT_TIMEOUT,       // arg = register waited on, value = wait us
+  OV5640_EVT_COUNT
+};
+
+struct OV5640_Event {
+  uint32_t us;              // camera clock
+  uint32_t value;
+  uint16_t arg;
+  uint8_t type;
+};
+
+struct OV5640_TelemetryCounters {
+  uint32_t events;          // recorded, including dropped ones
+  uint32_t dropped;         // ring full
+  uint32_t ops;
+  uint32_t failures;        // ops with a non-zero result
+  uint32_t commands;
+  uint32_t acks;
+  uint32_t ackWaitUs;       // summed over acks
+  uint32_t statusChanges;
+  uint32_t lensMoves;
+  uint32_t busTransactions;
+  uint32_t timeouts;
+};
+
+/**
+ * Lock-free single-producer / single-consumer ring of N elements (N a
+ * power of two).  push() only from the producer, pop() only from the
+ * consumer.
+ */
+template <class T, uint32_t N>
+class OV5640_SpscRing {
+  static_assert(N && !(N & (N - 1)), "ring size must be a power of two");
+
+public:
+  OV5640_SpscRing() : head(0), tail(0) {}
+
+  bool push(const T& v) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == N) return false;
+    buf[h & (N - 1)] = v;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& v) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return false;
+    v = buf[t & (N - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  uint32_t size() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+  static constexpr uint32_t capacity() { return N; }
+
+private:
+  T buf[N];
+  std::atomic<uint32_t> head;   // written by the producer
+  std::atomic<uint32_t> tail;   // written by the consumer
+};
+
+class OV5640_Telemetry {
+public:
+  OV5640_Telemetry();
+
+  /**
+   * Claim the producer side for owner (OV5640::setTelemetry() does this).
+   * @returns false if another owner holds it; true again for the same one
+   */
+  bool attach(const void* owner);
+  /** Give the producer side up, if owner holds it */
+  void detach(const void* owner);
+  const void* owner() const { return producer.load(std::memory_order_acquire); }
+
+  /** Producer side: append one event and update the counters */
+  void record(uint8_t type, uint16_t arg, uint32_t value, uint32_t us);
+
+  /** Consumer side: next event, false when the ring is empty */
+  bool read(OV5640_Event& e) { return ring.pop(e); }
+  /** Consumer side: up to max events into out; @returns how many */
+  uint32_t read(OV5640_Event* out, uint32_t max);
+  uint32_t pending() const { return ring.size(); }
+
+  /** Snapshot of the counters; safe from any task */
+  OV5640_TelemetryCounters counters() const;
+  /** Zero the counters; only while no operation is running */
+  void resetCounters();
+
+  static const char* eventName(uint8_t type);
+
+private:
+  OV5640_SpscRing<OV5640_Event, OV5640_TELEMETRY_RING> ring;
+  std::atomic<uint32_t> n[sizeof(OV5640_TelemetryCounters) / sizeof(uint32_t)];
+  std::atomic<const void*> producer;  // the camera recording into the ring
+};
+
+#endif
@@ -0,0 +1,202 @@
+/*
+  ESP32_OV5640_track.cpp - Predictive focus tracking for moving subjects
+  Released into the public domain.
+*/
+
+#include <math.h>
+#include "ESP32_OV5640_track.h"
+
+OV5640_Tracker::OV5640_Tracker(OV5640_SoftAF& _af)
+  : cam(_af.camera()), af(_af) {
+  cfg = defaultConfig();
+  resetStats();
+  reset();
+}
+
+OV5640_TrackConfig OV5640_Tracker::defaultConfig() {
+  OV5640_TrackConfig c;
+  c.alpha = 0.75f;
+  c.beta = 0.5f;
+  c.window = 192;
+  c.windowCoarse = 32;
+  c.minLocks = 1;
+  c.deadband = 4;
+  return c;
+}
+
+void OV5640_Tracker::reset() {
+  memset(hist, 0, sizeof(hist));
+  head = 0;
+  locks = 0;
+  pos = 0;
+  vel = 0;
+  lastUs = 0;
+  searchUs = 0;
+  lockScore = 0;
+}
+
+const OV5640_TrackPoint& OV5640_Tracker::history(uint8_t i) const {
+  return hist[(head + OV5640_TRACK_HISTORY - 1 - i) % OV5640_TRACK_HISTORY];
+}
+
+static uint16_t clampStep(float s) {
+  return s < 0 ? 0 : (s > 1023 ? 1023 : (uint16_t)(s + 0.5f));
+}
+
+uint16_t OV5640_Tracker::predict(uint32_t atUs) const {
+  if (!locks) return 0;
+  float dt = (int32_t)(atUs - lastUs) / 1e6f;
+  return clampStep(pos + vel * dt);
+}
+
+void OV5640_Tracker::addLock(uint16_t step, uint32_t atUs) {
+  if (locks == 0) {
+    pos = step;
+    vel = 0;
+  } else {
+    float dt = (int32_t)(atUs - lastUs) / 1e6f;
+    if (dt <= 0) {
+      pos = step;
+    } else if (locks == 1) {
+      /* two points: start from their slope */
+      vel = (step - pos) / dt;
+      pos = step;
+    } else {
+      float predicted = pos + vel * dt;
+      float r = step - predicted;
+      pos = predicted + cfg.alpha * r;
+      vel += cfg.beta * r / dt;
+    }
+  }
+
+  lastUs = atUs;
+  hist[head].step = step;
+  hist[head].atUs = atUs;
+  head = (head + 1) % OV5640_TRACK_HISTORY;
+  locks++;
+}
+
+uint8_t OV5640_Tracker::follow() {
+  if (!tracking() || cam.busy()) return 0;
+  uint16_t target = predict(cam.getClock()->nowUs());
+  const OV5640_AsyncOp* op = cam.currentOp();
+  if (op->type == OV5640_OP_MANUAL_FOCUS && op->result == 0 &&
+      (target > op->step ? target - op->step : op->step - target) < cfg.deadband)
+    return 0;
+  return cam.manualFocus(target);
+}
+
+/* Score three steps spacing apart around centre and walk toward the
+ * sharper side until the middle one wins, then interpolate the peak.
+ * lost is set once the walk would leave [lo, hi]. */
+uint8_t OV5640_Tracker::probe(uint16_t centre, uint16_t lo, uint16_t hi,
+                              uint16_t& lock, uint32_t& atUs, bool& lost) {
+  int32_t d = cfg.windowCoarse ? cfg.windowCoarse : 1;
+  int32_t c = centre;
+  if (c - d < lo) c = lo + d;
+  if (c + d > hi) c = hi - d;
+  lost = c - d < lo;                   // window narrower than the probe
+  if (lost) return 0;
+
+  uint32_t score[3], at[3];
+  uint8_t rc;
+  for (uint8_t i = 0; i < 3; i++) {
+    if ((rc = af.measure(c + (i - 1) * d, score[i], &at[i])) != 0) return rc;
+  }
+
+  while (score[1] < score[0] || score[1] < score[2]) {
+    int32_t dir = score[2] > score[0] ? 1 : -1;
+    int32_t next = c + 2 * dir * d;
+    if (next < lo || next > hi) {
+      lost = true;
+      return 0;
+    }
+    c += dir * d;
+    uint8_t k = dir > 0 ? 2 : 0;
+    if (dir > 0) {
+      score[0] = score[1]; at[0] = at[1];
+      score[1] = score[2]; at[1] = at[2];
+    } else {
+      score[2] = score[1]; at[2] = at[1];
+      score[1] = score[0]; at[1] = at[0];
+    }
+    if ((rc = af.measure(next, score[k], &at[k])) != 0) return rc;
+  }
+
+  /* a peak far duller than the last lock is noise on a flat curve */
+  if (score[1] < lockScore / 8) {
+    lost = true;
+    return 0;
+  }
+  lockScore = score[1];
+
+  /* sharpness falls off about exponentially with defocus: fit the
+   * parabola through the log scores, keep the vertex within half a spacing */
+  float l0 = logf(score[0] + 1.0f), l1 = logf(score[1] + 1.0f), l2 = logf(score[2] + 1.0f);
+  float den = l0 - 2 * l1 + l2;
+  int32_t off = den < 0 ? (int32_t)lroundf(d * (l0 - l2) / (2 * den)) : 0;
+  if (off > d / 2) off = d / 2;
+  if (off < -d / 2) off = -d / 2;
+  lock = (uint16_t)(c + off);
+  atUs = at[1];
+  return 0;
+}
+
+uint8_t OV5640_Tracker::relock(OV5640_TrackResult* result) {
+  OV5640_Clock* clock = cam.getClock();
+  uint32_t start = clock->nowUs();
+  OV5640_TrackResult r;
+  memset(&r, 0, sizeof(r));
+
+  const OV5640_SoftAFConfig& full = af.config();
+  OV5640_SoftAFResult res;
+  uint32_t atUs = start;
+
+  r.predicted = tracking();
+  if (r.predicted) {
+    /* aim where the subject should be when the middle frame is taken */
+    r.prediction = predict(start + searchUs / 2);
+    uint16_t lo = r.prediction > full.minStep + cfg.window ? r.prediction - cfg.window : full.minStep;
+    uint16_t hi = r.prediction + cfg.window < full.maxStep ? r.prediction + cfg.window : full.maxStep;
+    r.rc = probe(r.prediction, lo, hi, r.step, atUs, r.lost);
+
+    if (r.rc == 0 && r.lost) {
+      reset();
+      r.rc = af.run(&res);
+      r.step = res.step;
+      atUs = res.atUs;
+      lockScore = res.score;
+    }
+  } else {
+    r.rc = af.run(&res);
+    r.step = res.step;
+    atUs = res.atUs;
+    lockScore = res.score;
+  }
+
+  /* a full search seeds the estimate from its time per lens position,
+   * probes refine it */
+  uint32_t took = clock->nowUs() - start;
+  if (r.rc == 0 && (!r.predicted || r.lost)) {
+    if (!searchUs && res.stepsTried) searchUs = took / res.stepsTried * 3;
+  } else if (r.rc == 0) {
+    searchUs = searchUs ? (3 * searchUs + took) / 4 : took;
+  }
+
+  r.timeUs = took;
+  if (r.rc == 0) {
+    addLock(r.step, atUs);
+    if (r.predicted && !r.lost) {
+      r.error = (int16_t)r.step - (int16_t)r.prediction;
+      counters.predicted++;
+      counters.absErrorSum += r.error < 0 ? -r.error : r.error;
+    }
+    r.rc = cam.manualFocus(predict(clock->nowUs()));
+  }
+
+  counters.relocks++;
+  counters.lockUsSum += r.timeUs;
+  if (r.lost) counters.lost++;
+  if (result) *result = r;
+  return r.rc;
+}
@@ -0,0 +1,110 @@
+/*
+  ESP32_OV5640_track.h - Predictive focus tracking for moving subjects
+  Released into the public domain.
+
+  Every lock (lens step + time of the sharpest frame) feeds an alpha-beta
+  filter that estimates where the subject is and how fast it moves in lens
+  steps per second.  Between searches follow() keeps the lens on the
+  prediction with plain manualFocus() moves; relock() then scores three
+  steps around the prediction, walks toward the sharper side until the
+  middle one is sharpest and interpolates the peak.  Only a walk out of
+  the window, or a peak far duller than the last lock, costs a full
+  search.
+*/
+
+#ifndef ESP32_OV5640_track_h
+#define ESP32_OV5640_track_h
+
+#include "ESP32_OV5640_softaf.h"
+
+#define OV5640_TRACK_HISTORY              8
+
+struct OV5640_TrackConfig {
+  float alpha;            // position gain, 0..1
+  float beta;             // velocity gain, 0..1
+  uint16_t window;        // how far relock() may walk from the prediction
+  uint16_t windowCoarse;  // spacing of the three probe steps
+  uint8_t minLocks;       // locks before predictions are used
+  uint16_t deadband;      // follow() ignores smaller corrections
+};
+
+struct OV5640_TrackPoint {
+  uint16_t step;
+  uint32_t atUs;
+};
+
+struct OV5640_TrackResult {
+  uint8_t rc;
+  bool predicted;         // narrow search around a prediction
+  bool lost;              // walked out of the window or found no peak, fell back to a full search
+  uint16_t prediction;
+  uint16_t step;          // locked step
+  int16_t error;          // step - prediction
+  uint32_t timeUs;        // time to lock
+};
+
+struct OV5640_TrackStats {
+  uint32_t relocks;
+  uint32_t predicted;
+  uint32_t lost;
+  uint32_t absErrorSum;   // over predicted relocks
+  uint32_t lockUsSum;     // over all relocks
+  uint16_t meanAbsError() const { return predicted ? absErrorSum / predicted : 0; }
+  uint32_t meanLockUs() const { return relocks ? lockUsSum / relocks : 0; }
+};
+
+class OV5640_Tracker {
+public:
+  OV5640_Tracker(OV5640_SoftAF& _af);
+
+  /** alpha 0.75, beta 0.5, probes 32 steps apart within +/-192 steps, from the first lock on */
+  static OV5640_TrackConfig defaultConfig();
+  void configure(const OV5640_TrackConfig& _cfg) { cfg = _cfg; }
+  const OV5640_TrackConfig& config() const { return cfg; }
+
+  /** Forget the history and the filter state */
+  void reset();
+
+  /**
+   * One tracking search: a probe around the prediction once minLocks locks
+   * are in, the full SoftAF range otherwise.  The lock is fed to the filter
+   * and the lens left on the prediction for now.
+   * @returns the SoftAF result code
+   */
+  uint8_t relock(OV5640_TrackResult* result = NULL);
+  /** Move the lens to the predicted step for now; call once per frame */
+  uint8_t follow();
+  /** Feed a lock found some other way, e.g. a single-shot AF */
+  void addLock(uint16_t step, uint32_t atUs);
+
+  /** Predicted lens step at a time on the camera clock */
+  uint16_t predict(uint32_t atUs) const;
+  bool tracking() const { return locks >= cfg.minLocks; }
+  /** Estimated subject speed in lens steps per second */
+  float velocity() const { return vel; }
+
+  uint8_t historyCount() const { return locks < OV5640_TRACK_HISTORY ? locks : OV5640_TRACK_HISTORY; }
+  /** i = 0 is the most recent lock */
+  const OV5640_TrackPoint& history(uint8_t i) const;
+
+  const OV5640_TrackStats& stats() const { return counters; }
+  void resetStats() { memset(&counters, 0, sizeof(counters)); }
+
+private:
+  uint8_t probe(uint16_t centre, uint16_t lo, uint16_t hi, uint16_t& lock, uint32_t& atUs, bool& lost);
+
+  OV5640& cam;
+  OV5640_SoftAF& af;
+  OV5640_TrackConfig cfg;
+  OV5640_TrackStats counters;
+
+  OV5640_TrackPoint hist[OV5640_TRACK_HISTORY];
+  uint8_t head;
+  uint32_t locks;
+  float pos, vel;         // filter state at the last lock
+  uint32_t lastUs;
+  uint32_t searchUs;      // smoothed duration of a relock probe
+  uint32_t lockScore;     // sharpness at the last lock, 0 = unknown
+};
+
+#endif
@@ -0,0 +1,323 @@
+/*
+  ESP32_OV5640_trajectory.cpp - Settle-aware lens trajectory planner
+  Released into the public domain.
+*/
+
+#include <math.h>
+#include "ESP32_OV5640_trajectory.h"
+
+#define TWO_PI_F                          6.2831853f
+
+/********************  VCM ringing  ********************/
+
+void OV5640_VcmRing::advance(uint32_t t, uint32_t periodUs, uint32_t decayUs) {
+  int32_t dt = (int32_t)(t - atUs);
+  if (dt <= 0) return;
+  atUs = t;
+  if (!decayUs) {
+    re = im = 0;
+    return;
+  }
+  float env = expf(-(float)dt / decayUs);
+  float ph = periodUs ? TWO_PI_F * (float)(dt % periodUs) / periodUs : 0;
+  float c = cosf(ph), s = sinf(ph);
+  float r = env * (re * c - im * s);
+  im = env * (re * s + im * c);
+  re = r;
+}
+
+/* The drive slews at v from startUs to endUs.  Each change of slew rate
+ * leaves the lens lagging (or leading) by v/w and swinging: i*v/w at the
+ * start, -i*v/w at the end.  An instant step leaves it the whole step behind. */
+void OV5640_VcmRing::excite(float steps, uint32_t startUs, uint32_t endUs,
+                            uint32_t periodUs, uint32_t decayUs) {
+  advance(startUs, periodUs, decayUs);
+  if ((int32_t)(endUs - startUs) <= 0 || !periodUs) {
+    re -= steps;
+    return;
+  }
+  float lag = steps / (endUs - startUs) * periodUs / TWO_PI_F;
+  im += lag;
+  advance(endUs, periodUs, decayUs);
+  im -= lag;
+}
+
+float OV5640_VcmRing::offset(uint32_t t, uint32_t periodUs, uint32_t decayUs) const {
+  OV5640_VcmRing r = *this;
+  r.advance(t, periodUs, decayUs);
+  return r.re;
+}
+
+float OV5640_VcmRing::amplitude() const {
+  return sqrtf(re * re + im * im);
+}
+
+uint32_t OV5640_VcmRing::settleUs(float tol, uint32_t decayUs) const {
+  float a = amplitude();
+  if (a <= tol || tol <= 0) return 0;
+  return (uint32_t)(decayUs * logf(a / tol));
+}
+
+/********************  planner  ********************/
+
+OV5640_LensPlanner::OV5640_LensPlanner(OV5640& _cam) : cam(_cam) {
+  cfg = defaultConfig();
+  resetStats();
+  pos = OV5640_LENS_UNKNOWN;
+  memset(&cur, 0, sizeof(cur));
+  seg = 0;
+  waiting = false;
+  result = 0;
+  firstUs = 0;
+  issuedUs = 0;
+  leadUs = 0;
+  settleAt = 0;
+}
+
+OV5640_LensPlanConfig OV5640_LensPlanner::defaultConfig() {
+  OV5640_LensPlanConfig c;
+  c.vcm.periodUs = 10000;
+  c.vcm.decayUs = 30000;
+  c.vcm.startUs = 0;
+  c.vcm.usPerStep = 10;
+  c.vcm.ackUs = 1000;
+  c.order = 2;
+  c.toleranceSteps = 4;
+  c.uncertainty = 0.1f;
+  return c;
+}
+
+/* Unknown start: the far end from the target */
+static uint16_t knownFrom(uint16_t from, uint16_t to) {
+  if (from != OV5640_LENS_UNKNOWN) return from;
+  return to < 512 ? 1023 : 0;
+}
+
+uint32_t OV5640_LensPlanner::slewUs(uint16_t a, uint16_t b) const {
+  a = knownFrom(a, b);
+  return (uint32_t)(a > b ? a - b : b - a) * cfg.vcm.usPerStep;
+}
+
+uint32_t OV5640_LensPlanner::travelUs(uint16_t a, uint16_t b) const {
+  return cfg.vcm.startUs + slewUs(a, b);
+}
+
+/* Model i of the three kept: the period spread by -/0/+ uncertainty, the
+ * decay at the long end and the tolerance shrunk by it for the amplitude */
+#define RING_PERIOD(i) ((uint32_t)(cfg.vcm.periodUs * (1 + ((int)(i) - 1) * cfg.uncertainty)))
+#define RING_DECAY     ((uint32_t)(cfg.vcm.decayUs * (1 + cfg.uncertainty)))
+#define RING_TOL       (cfg.toleranceSteps / (1 + cfg.uncertainty))
+
+void OV5640_LensPlanner::plan(uint16_t from, uint16_t to, OV5640_LensPlan& out) const {
+  to &= 0x03FF;
+  int32_t d = (int32_t)to - knownFrom(from, to);
+  uint32_t dist = d < 0 ? -d : d;
+  uint8_t order = cfg.order < OV5640_LENS_MAX_ORDER ? cfg.order : OV5640_LENS_MAX_ORDER;
+  if (from == OV5640_LENS_UNKNOWN || cfg.vcm.periodUs < 2 || !cfg.vcm.decayUs || dist <= order)
+    order = 0;
+  shape(from, to, order, out);
+
+  /* a slew of about a period cancels most of its own ringing, and a small
+   * jump may ring within the tolerance: keep the jump when it settles first */
+  if (order) {
+    OV5640_LensPlan jump;
+    shape(from, to, 0, jump);
+    if (jump.settleUs <= out.settleUs) out = jump;
+  }
+}
+
+void OV5640_LensPlanner::shape(uint16_t from, uint16_t to, uint8_t order,
+                               OV5640_LensPlan& out) const {
+  memset(&out, 0, sizeof(out));
+  out.from = from;
+  out.to = to;
+  if (from == to) return;
+  int32_t d = (int32_t)to - knownFrom(from, to);
+  uint32_t dist = d < 0 ? -d : d;
+
+  /* weights: binomial series of K, the decay over one gap, divided by how
+   * much of its step each slew passes on to the ringing (sinc of half the
+   * slew in radians of the period); the gap is the first odd number of
+   * half periods the ACK wait (up to twice its latency with the default
+   * backoff) and the slews either side of it fit into */
+  float w[OV5640_LENS_MAX_SEGMENTS] = { 1 };
+  float b[OV5640_LENS_MAX_SEGMENTS];
+  uint32_t gap = 0;
+  for (uint32_t k = 1; order; k += 2) {
+    gap = k * cfg.vcm.periodUs / 2;
+    float K = expf(-(float)gap / cfg.vcm.decayUs);
+    for (uint8_t j = 0; j <= order; j++) {
+      b[j] = j ? b[j - 1] * K * (order - j + 1) / j : 1;
+      w[j] = b[j];
+    }
+    for (uint8_t n = 0; n < 4; n++) {
+      float sum = 0;
+      for (uint8_t j = 0; j <= order; j++) sum += w[j];
+      for (uint8_t j = 0; j <= order; j++) {
+        float x = TWO_PI_F / 2 * w[j] / sum * dist * cfg.vcm.usPerStep / cfg.vcm.periodUs;
+        float sinc = x > 0.01f ? sinf(x) / x : 1;
+        w[j] = b[j] / (sinc > 0.25f ? sinc : 0.25f);
+      }
+    }
+    float sum = 0;
+    for (uint8_t j = 0; j <= order; j++) sum += w[j];
+    uint32_t need = 0, prev = 0;
+    for (uint8_t j = 0; j <= order; j++) {
+      w[j] /= sum;
+      uint32_t t = (uint32_t)(w[j] * dist) * cfg.vcm.usPerStep;
+      if (j && 3 * cfg.vcm.startUs + 2 * cfg.vcm.ackUs + (prev + t) / 2 > need)
+        need = 3 * cfg.vcm.startUs + 2 * cfg.vcm.ackUs + (prev + t) / 2;
+      prev = t;
+    }
+    if (gap >= need) break;
+  }
+
+  /* cumulative targets, the last one exact; the slews are centred a gap
+   * apart, so a segment lands half its slew after its centre */
+  float done = 0;
+  uint32_t mid = 0;
+  for (uint8_t j = 0; j <= order; j++) {
+    done += w[j];
+    uint16_t s = j == order ? to : (uint16_t)(knownFrom(from, to) + lroundf(d * done));
+    uint32_t slew = slewUs(j ? out.step[j - 1] : from, s);
+    if (!j) mid = cfg.vcm.startUs + slew / 2;
+    out.step[j] = s;
+    out.landUs[j] = mid + j * gap + (slew + 1) / 2;
+  }
+  out.count = order + 1;
+
+  /* estimate from rest, ignoring ringing left over from earlier moves */
+  uint32_t settle = 0;
+  for (uint8_t i = 0; i < 3; i++) {
+    OV5640_VcmRing r;
+    uint16_t prev = knownFrom(from, to);
+    for (uint8_t j = 0; j < out.count; j++) {
+      r.excite((float)out.step[j] - prev, out.landUs[j] - slewUs(prev, out.step[j]),
+               out.landUs[j], RING_PERIOD(i), RING_DECAY);
+      prev = out.step[j];
+    }
+    uint32_t s = r.settleUs(RING_TOL, RING_DECAY);
+    if (s > settle) settle = s;
+  }
+  out.settleUs = out.landUs[order] + settle;
+}
+
+void OV5640_LensPlanner::landed(uint16_t from, uint16_t to, uint32_t atUs) {
+  from = knownFrom(from, to);
+  uint32_t settle = 0;
+  for (uint8_t i = 0; i < 3; i++) {
+    ring[i].excite((float)to - from, atUs - slewUs(from, to), atUs, RING_PERIOD(i), RING_DECAY);
+    uint32_t s = ring[i].settleUs(RING_TOL, RING_DECAY);
+    if (s > settle) settle = s;
+  }
+  settleAt = atUs + settle;
+}
+
+bool OV5640_LensPlanner::issue() {
+  OV5640_Clock* clock = cam.getClock();
+  uint32_t t = clock->nowUs();
+  if (!cam.manualFocusAsync(cur.step[seg])) return false;
+  cam.poll();                               // command on the bus now
+  uint32_t now = clock->nowUs();
+  leadUs = now - t;                         // parameter and command writes
+  if (seg == 0) {
+    firstUs = now;
+  } else if ((int32_t)(now - firstUs - slot(seg)) > (int32_t)(cfg.vcm.periodUs / 8)) {
+    counters.late++;
+  }
+  issuedUs = now;
+  waiting = true;
+  seg++;
+  counters.segments++;
+  return true;
+}
+
+/* When segment i has to be on the bus to land in its slot, after the first command */
+uint32_t OV5640_LensPlanner::slot(uint8_t i) const {
+  return cur.landUs[i] - travelUs(cur.step[i - 1], cur.step[i]);
+}
+
+bool OV5640_LensPlanner::moveAsync(uint16_t step) {
+  if (busy() || cam.busy()) return false;
+  plan(pos, step, cur);
+  seg = 0;
+  waiting = false;
+  result = 0;
+  counters.moves++;
+  if (!cur.count) return true;
+  if (!issue()) {
+    cur.count = 0;
+    return false;
+  }
+  return true;
+}
+
+bool OV5640_LensPlanner::poll() {
+  if (waiting) {
+    if (cam.poll()) return true;
+    waiting = false;
+    uint16_t from = seg > 1 ? cur.step[seg - 2] : cur.from;
+    uint16_t to = cur.step[seg - 1];
+    landed(from, to, issuedUs + travelUs(from, to));
+    pos = to;
+    result = cam.currentOp()->result;
+    if (result) {
+      seg = cur.count;                      // give up on the rest
+      pos = OV5640_LENS_UNKNOWN;
+    }
+  }
+  if (seg >= cur.count) return false;
+
+  if ((int32_t)(cam.getClock()->nowUs() + leadUs - firstUs - slot(seg)) >= 0 && !issue()) {
+    result = OV5640_ERR_NOT_OV5640;         // someone else took the camera
+    seg = cur.count;
+    return false;
+  }
+  return true;
+}
+
+/* Run the current move to its end, sleeping until the next status read
+ * or the next segment's slot */
+void OV5640_LensPlanner::drain() {
+  OV5640_Clock* clock = cam.getClock();
+  while (poll()) {
+    uint32_t now = clock->nowUs();
+    int32_t dt = waiting ? (int32_t)(cam.currentOp()->pollAt - now)
+                         : (int32_t)(firstUs + slot(seg) - leadUs - now);
+    if (dt > 0) clock->sleepUs(dt);
+  }
+}
+
+uint8_t OV5640_LensPlanner::move(uint16_t step) {
+  drain();                                  // a move started with moveAsync()
+  cam.wait();
+  if (!moveAsync(step)) return OV5640_ERR_NOT_OV5640;
+  drain();
+  return result;
+}
+
+uint8_t OV5640_LensPlanner::moveAndSettle(uint16_t step) {
+  uint8_t rc = move(step);
+  if (rc == 0) {
+    uint32_t us = settleRemainingUs();
+    if (us) cam.getClock()->sleepUs(us);
+  }
+  return rc;
+}
+
+void OV5640_LensPlanner::noteMove(uint16_t step, uint32_t issuedAt) {
+  step &= 0x03FF;
+  landed(pos, step, issuedAt + travelUs(pos, step));
+  pos = step;
+}
+
+bool OV5640_LensPlanner::settled() const {
+  return !busy() && settleRemainingUs() == 0;
+}
+
+uint32_t OV5640_LensPlanner::settleRemainingUs() const {
+  uint32_t now = cam.getClock()->nowUs();
+  uint32_t at = busy() ? firstUs + cur.settleUs : settleAt;
+  int32_t dt = (int32_t)(at - now);
+  return dt > 0 ? dt : 0;
+}
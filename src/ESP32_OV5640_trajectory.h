@@ -0,0 +1,151 @@
+/*
+  ESP32_OV5640_trajectory.h - Settle-aware lens trajectory planner
+  Released into the public domain.
+
+  A VCM lens does not stop dead: it is a mass on the VCM spring, so after
+  the driver slews to a new position it rings around the target and dies
+  away over tens of milliseconds, and frames are soft until it does.
+  OV5640_VcmModel describes that as a damped oscillation (period, decay
+  time) driven by the slew.
+
+  The planner splits a move into up to OV5640_LENS_MAX_SEGMENTS steps
+  sized and timed from the model so the ringing of each step cancels the
+  one before it (input shaping: the steps land an odd number of half
+  periods apart, weighted by the binomial series of the decay over one
+  gap).  It keeps the same model running over the moves it made, with the
+  period and decay spread by `uncertainty`, and reports the
+  earliest time the lens is within toleranceSteps of the target for good:
+  settledAtUs() / settled().  Capture can start then instead of after a
+  fixed worst-case delay.
+*/
+
+#ifndef ESP32_OV5640_trajectory_h
+#define ESP32_OV5640_trajectory_h
+
+#include "ESP32_OV5640_AF.h"
+
+#define OV5640_LENS_MAX_SEGMENTS          4
+#define OV5640_LENS_MAX_ORDER             (OV5640_LENS_MAX_SEGMENTS - 1)
+#define OV5640_LENS_UNKNOWN               0xFFFF
+
+struct OV5640_VcmModel {
+  uint32_t periodUs;      // ringing period, 1 / resonance
+  uint32_t decayUs;       // envelope time constant, 1 / (2 pi resonance damping); 0 = no ringing
+  uint32_t startUs;       // command write until the lens starts to move
+  uint16_t usPerStep;     // travel time per step
+  uint32_t ackUs;         // command write until the ACK clears, beyond travel
+};
+
+/**
+ * Ringing of one lens as a phasor: the offset from the drive at time t is
+ * Re(c * e^((i*w - 1/decay) * (t - atUs))).  Moves add to it linearly.
+ */
+class OV5640_VcmRing {
+public:
+  OV5640_VcmRing() { reset(); }
+  void reset() { re = im = 0; atUs = 0; }
+
+  /** The drive slewing by `steps` (signed) from startUs, landing at endUs */
+  void excite(float steps, uint32_t startUs, uint32_t endUs, uint32_t periodUs, uint32_t decayUs);
+  /** Offset from the target in steps at time t (t not before the last landing) */
+  float offset(uint32_t t, uint32_t periodUs, uint32_t decayUs) const;
+  /** Envelope at the last landing */
+  float amplitude() const;
+  /** Time after the last landing at which the envelope drops to tol */
+  uint32_t settleUs(float tol, uint32_t decayUs) const;
+
+private:
+  void advance(uint32_t t, uint32_t periodUs, uint32_t decayUs);
+  float re, im;
+  uint32_t atUs;
+};
+
+struct OV5640_LensPlanConfig {
+  OV5640_VcmModel vcm;
+  uint8_t order;          // 0 = one jump, 1 = two steps (ZV), 2 = three (ZVD), ...
+  uint16_t toleranceSteps;   // settled once the ringing stays within this
+  float uncertainty;      // relative error of period and decay
+};
+
+struct OV5640_LensPlan {
+  uint16_t from, to;
+  uint8_t count;          // segments
+  uint16_t step[OV5640_LENS_MAX_SEGMENTS];
+  uint32_t landUs[OV5640_LENS_MAX_SEGMENTS];   // after the first command
+  uint32_t settleUs;      // estimated: first command until settled
+};
+
+struct OV5640_LensPlanStats {
+  uint32_t moves;
+  uint32_t segments;
+  uint32_t late;          // segments issued after their slot (ACK wait ran long)
+};
+
+class OV5640_LensPlanner {
+public:
+  OV5640_LensPlanner(OV5640& _cam);
+
+  /** Generic VCM: 10 ms period, 30 ms decay, 10 us per step; ZVD shaping */
+  static OV5640_LensPlanConfig defaultConfig();
+  void configure(const OV5640_LensPlanConfig& _cfg) { cfg = _cfg; }
+  const OV5640_LensPlanConfig& config() const { return cfg; }
+
+  /**
+   * Where the lens is, e.g. after an AF search.  Until it is known the
+   * first move is a single jump, estimated as if from the far end.
+   */
+  void setPosition(uint16_t step) { pos = step; }
+  uint16_t position() const { return pos; }
+
+  /** The plan for a move, without moving */
+  void plan(uint16_t from, uint16_t to, OV5640_LensPlan& out) const;
+
+  /**
+   * Start a planned move; poll() issues the remaining segments.
+   * @returns false while the camera is busy
+   */
+  bool moveAsync(uint16_t step);
+  /** Issue the next segment once it is due; @returns true while a move is running */
+  bool poll();
+  /** Move and return once the last segment has landed; @returns the manualFocus() code */
+  uint8_t move(uint16_t step);
+  /** move(), then sleep until settled() */
+  uint8_t moveAndSettle(uint16_t step);
+  /** A move made with plain manualFocus(), so settled() covers it too */
+  void noteMove(uint16_t step, uint32_t issuedUs);
+
+  bool busy() const { return waiting || seg < cur.count; }
+  /** Estimated time (camera clock) the lens stays within toleranceSteps */
+  uint32_t settledAtUs() const { return settleAt; }
+  bool settled() const;
+  uint32_t settleRemainingUs() const;
+  const OV5640_LensPlan& currentPlan() const { return cur; }
+
+  const OV5640_LensPlanStats& stats() const { return counters; }
+  void resetStats() { memset(&counters, 0, sizeof(counters)); }
+
+private:
+  void shape(uint16_t from, uint16_t to, uint8_t order, OV5640_LensPlan& out) const;
+  uint32_t slewUs(uint16_t a, uint16_t b) const;
+  uint32_t travelUs(uint16_t a, uint16_t b) const;
+  void landed(uint16_t from, uint16_t to, uint32_t atUs);
+  bool issue();
+  uint32_t slot(uint8_t i) const;
+  void drain();
+
+  OV5640& cam;
+  OV5640_LensPlanConfig cfg;
+  OV5640_LensPlanStats counters;
+  OV5640_VcmRing ring[3];   // short period, nominal, long period
+  uint16_t pos;
+  OV5640_LensPlan cur;
+  uint8_t seg;              // next segment to issue
+  bool waiting;             // segment seg - 1 on the bus
+  uint8_t result;
+  uint32_t firstUs;         // first command
+  uint32_t issuedUs;        // last command
+  uint32_t leadUs;          // bus time to issue a segment
+  uint32_t settleAt;
+};
+
+#endif
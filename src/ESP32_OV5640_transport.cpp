@@ -0,0 +1,65 @@
+/*
+  ESP32_OV5640_transport.cpp - Register transports for the OV5640 AF library
+  Released into the public domain.
+*/
+
+#include "ESP32_OV5640_transport.h"
+
+OV5640_Transport::OV5640_Transport() {
+  resetStats();
+}
+
+void OV5640_Transport::resetStats() {
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+int OV5640_Transport::write(uint16_t reg, uint8_t val) {
+  countWrite();
+  return writeReg(reg, val);
+}
+
+int OV5640_Transport::read(uint16_t reg) {
+  countRead();
+  return readReg(reg);
+}
+
+int OV5640_Transport::writeSeq(uint16_t reg, const uint8_t* data, size_t len, size_t chunk) {
+  size_t burst = maxBurst();
+  int rc;
+
+  if (burst == 0 || chunk == 1) {
+    for (size_t i = 0; i < len; i++) {
+      rc = write(reg + i, data[i]);
+      if (rc < 0) return rc;
+    }
+    return 0;
+  }
+
+  if (chunk == 0 || chunk > burst) chunk = burst;
+  while (len) {
+    size_t n = len < chunk ? len : chunk;
+    _stats.transactions++;
+    _stats.bytes += 2 + n;
+    _stats.writes += n;
+    rc = writeBurst(reg, data, n);
+    if (rc < 0) return rc;
+    reg += n;
+    data += n;
+    len -= n;
+  }
+  return 0;
+}
+
+int OV5640_Transport::writeBurst(uint16_t reg, const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    int rc = writeReg(reg + i, data[i]);
+    if (rc < 0) return rc;
+  }
+  return 0;
+}
+
+/********************  esp32-camera SCCB  ********************/
+
+OV5640_SCCBTransport::OV5640_SCCBTransport(sensor_t* _sensor) {
+  sensor = _sensor;
+}
@@ -0,0 +1,161 @@
+/*
+  ESP32_OV5640_transport.h - Register transports for the OV5640 AF library
+  Released into the public domain.
+*/
+
+#ifndef ESP32_OV5640_transport_h
+#define ESP32_OV5640_transport_h
+
+#include "ESP32_OV5640_port.h"
+
+#define OV5640_SCCB_ADDR                  0x3C   // 7-bit SCCB address
+#define OV5640_BURST_DEFAULT              64     // bytes per sequential write
+
+/* Bus accounting.  "bytes" counts what goes on the wire after the device
+ * address: the 16-bit register address plus the data bytes. */
+struct OV5640_BusStats {
+  uint32_t transactions;
+  uint32_t bytes;
+  uint32_t writes;      // register bytes written
+  uint32_t reads;       // register bytes read
+};
+
+/**
+ * Register access used by OV5640.  Subclasses implement single-register
+ * read/write and, when the bus allows it, a sequential (auto-increment)
+ * write of several bytes in one addressed transaction.
+ */
+class OV5640_Transport {
+public:
+  OV5640_Transport();
+  virtual ~OV5640_Transport() {}
+
+  /** @returns 0 on success, <0 on bus error */
+  int write(uint16_t reg, uint8_t val);
+  /** @returns register value 0..255, <0 on bus error */
+  int read(uint16_t reg);
+  /**
+   * Write len bytes starting at reg.  Uses sequential transactions of at
+   * most chunk bytes when the transport supports them (chunk 0 = maxBurst()),
+   * otherwise falls back to one write per byte.
+   */
+  int writeSeq(uint16_t reg, const uint8_t* data, size_t len, size_t chunk = 0);
+
+  /** Largest sequential write in bytes; 0 if the transport has none. */
+  virtual size_t maxBurst() const { return 0; }
+
+  const OV5640_BusStats& stats() const { return _stats; }
+  void resetStats();
+
+protected:
+  virtual int writeReg(uint16_t reg, uint8_t val) = 0;
+  virtual int readReg(uint16_t reg) = 0;
+  virtual int writeBurst(uint16_t reg, const uint8_t* data, size_t len);
+
+  void countWrite() {
+    _stats.transactions++;
+    _stats.bytes += 3;
+    _stats.writes++;
+  }
+  /* SCCB has no repeated start: address phase and data phase are two
+   * separate transactions. */
+  void countRead() {
+    _stats.transactions += 2;
+    _stats.bytes += 3;
+    _stats.reads++;
+  }
+
+  OV5640_BusStats _stats;
+};
+
+/* esp32-camera SCCB through sensor_t::set_reg/get_reg (single bytes only). */
+class OV5640_SCCBTransport : public OV5640_Transport {
+public:
+  OV5640_SCCBTransport(sensor_t* _sensor = NULL);
+  void begin(sensor_t* _sensor) { sensor = _sensor; }
+
+  /* write() / read() bound at compile time, for OV5640_CameraBus */
+  int writeDirect(uint16_t reg, uint8_t val) {
+    countWrite();
+    return OV5640_SCCBTransport::writeReg(reg, val);
+  }
+  int readDirect(uint16_t reg) {
+    countRead();
+    return OV5640_SCCBTransport::readReg(reg);
+  }
+
+protected:
+  virtual int writeReg(uint16_t reg, uint8_t val) {
+    if (!sensor) return -1;
+    return sensor->set_reg(sensor, reg, 0xff, val);
+  }
+  virtual int readReg(uint16_t reg) {
+    if (!sensor) return -1;
+    return sensor->get_reg(sensor, reg, 0xff);
+  }
+
+private:
+  sensor_t* sensor;
+};
+
+#if defined(ARDUINO)
+#include <Wire.h>
+
+/**
+ * Raw I2C with sequential writes, as a bus policy for OV5640_Core and as
+ * the body of OV5640_WireTransport.  The camera driver must not be using
+ * the same I2C port at the same time (see sccb_i2c_port in
+ * camera_config_t).
+ */
+struct OV5640_WireBus {
+  TwoWire* wire;
+  uint8_t addr;
+
+  explicit OV5640_WireBus(TwoWire& _wire = Wire, uint8_t _addr = OV5640_SCCB_ADDR)
+    : wire(&_wire), addr(_addr) {}
+
+  int read(uint16_t reg) {
+    wire->beginTransmission(addr);
+    wire->write((uint8_t)(reg >> 8));
+    wire->write((uint8_t)(reg & 0xff));
+    if (wire->endTransmission(true) != 0) return -1;
+    if (wire->requestFrom(addr, (uint8_t)1) != 1) return -1;
+    return wire->read();
+  }
+  int write(uint16_t reg, uint8_t val) { return writeBurst(reg, &val, 1); }
+  int writeBurst(uint16_t reg, const uint8_t* data, size_t len) {
+    wire->beginTransmission(addr);
+    wire->write((uint8_t)(reg >> 8));
+    wire->write((uint8_t)(reg & 0xff));
+    wire->write(data, len);
+    return (wire->endTransmission(true) == 0) ? 0 : -1;
+  }
+  size_t maxBurst() const {
+#ifdef I2C_BUFFER_LENGTH
+    return I2C_BUFFER_LENGTH - 2;       // minus the register address
+#else
+    return 30;                          // classic 32-byte Wire buffer
+#endif
+  }
+};
+
+/* OV5640_WireBus behind the virtual interface, with bus statistics */
+class OV5640_WireTransport : public OV5640_Transport {
+public:
+  OV5640_WireTransport(TwoWire& _wire = Wire, uint8_t _addr = OV5640_SCCB_ADDR)
+    : io(_wire, _addr) {}
+  virtual size_t maxBurst() const { return io.maxBurst(); }
+
+protected:
+  virtual int writeReg(uint16_t reg, uint8_t val) { return io.write(reg, val); }
+  virtual int readReg(uint16_t reg) { return io.read(reg); }
+  virtual int writeBurst(uint16_t reg, const uint8_t* data, size_t len) {
+    return io.writeBurst(reg, data, len);
+  }
+
+private:
+  OV5640_WireBus io;
+};
+#endif
+
+#endif